@@ -0,0 +1,27 @@
+// A block device driver, as the I/O scheduler sees it.
+// Each disk registers one with bdevregister(). The hooks
+// are passed the bdev itself, so that one driver can run
+// several devices, each with its own priv.
+struct bdev {
+  char *name;
+  void *priv;           // the driver's own
+
+  // start request r. returns 0 if r is on its way, and will be
+  // handed to r->done() when it is finished; 1 if r finished
+  // before submit returned; -1 if the device has no room for r
+  // now.
+  int (*submit)(struct bdev*, struct ioreq *r);
+
+  // make every write the device has finished durable.
+  // 0 if finished writes are durable already.
+  void (*flush)(struct bdev*);
+
+  // size of the device, in blocks.
+  uint (*capacity)(struct bdev*);
+
+  // completion polling (see waitdone() in iosched.c).
+  // 0 if the device cannot be polled.
+  void (*pollstart)(struct bdev*);
+  void (*poll)(struct bdev*);
+  void (*pollend)(struct bdev*);
+};
@@ -1,6 +1,6 @@
 // Buffer cache.
 //
-// The buffer cache is a linked list of buf structures holding
+// The buffer cache is a hash table of buf structures holding
 // cached copies of disk block contents.  Caching disk blocks
 // in memory reduces the number of disk reads and also provides
 // a synchronization point for disk blocks used by multiple processes.
@@ -22,70 +22,271 @@
 #include "defs.h"
 #include "fs.h"
 #include "buf.h"
+#include "sysctl.h"
 
+#define NBUCKET 251  // hash buckets; prime, so that blocks spread evenly
+
+// Beyond the NBUF static buffers, the cache grows a page of
+// buffers at a time from kalloc(), on misses, until it holds
+// BCACHEPCT percent of the free memory. It may always grow by
+// as many buffers as the log may pin (breserve()), whatever
+// the limit set with sysctl(). When kalloc() runs low
+// it calls bshrink(), which gives back pages whose buffers are
+// all unused.
+struct bufpage {
+  struct bufpage *next;
+  int dying;             // being freed by bshrink()
+  struct buf buf[(PGSIZE - 2*sizeof(void*)) / sizeof(struct buf)];
+};
+
+#define BUFPERPAGE NELEM(((struct bufpage*)0)->buf)
+
+// Buffers are hashed by (dev, blockno) into buckets, each a
+// linked list through next, protected by its own lock, so that
+// lookups of different blocks do not contend. A buffer not in
+// use records when it was last released, and a miss that
+// cannot grow the cache recycles the unused buffer that the
+// replacement policy (bpolicy.c) picks, wherever it is, moving
+// it to the right bucket.
+//
+// Only a process holding evictlock may hold two bucket locks,
+// so bucket locks are always taken in a deadlock-free order:
+// with evictlock held, any order goes.
 struct {
-  struct spinlock lock;
+  struct spinlock evictlock;
   struct buf buf[NBUF];
+  struct bufpage *pages;  // protected by evictlock
+  int npages;
+  int maxbufs;            // limit set with sysctl(), or 0
+  int reserve;            // buffers the log may pin
+  struct bpolicy *policy; // protected by evictlock
 
-  // Linked list of all buffers, through prev/next.
-  // Sorted by how recently the buffer was used.
-  // head.next is most recent, head.prev is least.
-  struct buf head;
+  struct {
+    struct spinlock lock;
+    struct buf *head;
+  } bucket[NBUCKET];
+
+  uint64 hits;
+  uint64 misses;
 } bcache;
 
+static struct bpolicy *policies[] = {
+[BPOL_LRU] &lrupolicy,
+[BPOL_2Q]  &twoqpolicy,
+};
+
+static int
+bhash(uint dev, uint blockno)
+{
+  return (dev * 31 + blockno) % NBUCKET;
+}
+
+static int
+nbufs(void)
+{
+  return NBUF + bcache.npages * (int)BUFPERPAGE;
+}
+
 void
 binit(void)
 {
   struct buf *b;
+  int i;
 
-  initlock(&bcache.lock, "bcache");
+  initlock(&bcache.evictlock, "bcache.evict");
+  for(i = 0; i < NBUCKET; i++){
+    initlocknostat(&bcache.bucket[i].lock, "bcache.bucket");
+    bcache.bucket[i].head = 0;
+  }
+  // one lockstat line for all of them.
+  lockstatgroup("bcache.bucket", "spin", &bcache.bucket[0].lock.stat,
+                NBUCKET, sizeof(bcache.bucket[0]));
 
-  // Create linked list of buffers
-  bcache.head.prev = &bcache.head;
-  bcache.head.next = &bcache.head;
-  for(b = bcache.buf; b < bcache.buf+NBUF; b++){
-    b->next = bcache.head.next;
-    b->prev = &bcache.head;
+  // Spread the buffers over the buckets, so that the first
+  // misses need not all steal from one of them.
+  for(b = bcache.buf, i = 0; b < bcache.buf+NBUF; b++, i++){
     initsleeplock(&b->lock, "buffer");
-    bcache.head.next->prev = b;
-    bcache.head.next = b;
+    b->lastuse = 0;
+    b->queue = 0;
+    b->next = bcache.bucket[i % NBUCKET].head;
+    bcache.bucket[i % NBUCKET].head = b;
   }
+  bcache.policy = &twoqpolicy;
+  bcache.policy->reset();
+  kshrinkadd(bshrink);
 }
 
-// Look through buffer cache for block on device dev.
-// If not found, allocate a buffer.
-// In either case, return locked buffer.
+// Find dev/blockno in bucket h, and take a reference to it.
+// Caller must hold the bucket's lock.
 static struct buf*
-bget(uint dev, uint blockno)
+bfind(int h, uint dev, uint blockno)
 {
   struct buf *b;
 
-  acquire(&bcache.lock);
-
-  // Is the block already cached?
-  for(b = bcache.head.next; b != &bcache.head; b = b->next){
+  for(b = bcache.bucket[h].head; b; b = b->next){
     if(b->dev == dev && b->blockno == blockno){
       b->refcnt++;
-      release(&bcache.lock);
-      acquiresleep(&b->lock);
       return b;
     }
   }
+  return 0;
+}
 
-  // Not cached.
-  // Recycle the least recently used (LRU) unused buffer.
-  for(b = bcache.head.prev; b != &bcache.head; b = b->prev){
-    if(b->refcnt == 0) {
-      b->dev = dev;
-      b->blockno = blockno;
-      b->valid = 0;
-      b->refcnt = 1;
-      release(&bcache.lock);
-      acquiresleep(&b->lock);
-      return b;
+// May the cache take another page?
+static int
+bcangrow(void)
+{
+  uint64 free = kfreepages();
+
+  if(nbufs() < NBUF + bcache.reserve)
+    return 1;
+  if(bcache.maxbufs && nbufs() + BUFPERPAGE > bcache.maxbufs)
+    return 0;
+  return (bcache.npages + 1) * 100 <= (free + bcache.npages) * BCACHEPCT;
+}
+
+// Allocate and initialize a page of buffers, or return 0.
+// kalloc() may call bshrink(), so the caller must not
+// hold any bcache lock.
+static struct bufpage*
+bnewpage(void)
+{
+  struct bufpage *pg;
+
+  if(!bcangrow() || (pg = kalloc()) == 0)
+    return 0;
+  pg->next = 0;
+  pg->dying = 0;
+  for(int i = 0; i < BUFPERPAGE; i++){
+    struct buf *b = &pg->buf[i];
+    // there may be many of these; lockstat counts only the
+    // static buffers.
+    initsleeplocknostat(&b->lock, "buffer");
+    b->valid = 0;
+    b->disk = 0;
+    b->dev = 0;
+    b->blockno = 0;
+    b->refcnt = 0;
+    b->lastuse = 0;
+    b->queue = 0;
+  }
+  return pg;
+}
+
+// Should a be recycled sooner than b? Buffers holding no
+// block go first. Caller must hold evictlock.
+static int
+bbefore(struct buf *a, struct buf *b)
+{
+  if(a->queue == 0 || b->queue == 0)
+    return a->queue == 0 && b->queue != 0;
+  return bcache.policy->before(a, b);
+}
+
+// Look through buffer cache for block on device dev.
+// If not found, allocate a buffer.
+// In either case, return it referenced but not locked.
+static struct buf*
+bgetref(uint dev, uint blockno)
+{
+  struct buf *b, **pp, **victimpp;
+  struct bufpage *pg;
+  int h = bhash(dev, blockno);
+  int i, vb;
+
+  // Is the block already cached?
+  acquire(&bcache.bucket[h].lock);
+  if((b = bfind(h, dev, blockno)) != 0){
+    release(&bcache.bucket[h].lock);
+    __sync_fetch_and_add(&bcache.hits, 1);
+    __sync_fetch_and_add(&bcache.policy->hits, 1);
+    return b;
+  }
+  release(&bcache.bucket[h].lock);
+  __sync_fetch_and_add(&bcache.misses, 1);
+  __sync_fetch_and_add(&bcache.policy->misses, 1);
+
+  pg = bnewpage();
+
+  // Not cached. Serialize with other misses, and check again:
+  // another process may have brought it in meanwhile.
+  acquire(&bcache.evictlock);
+  acquire(&bcache.bucket[h].lock);
+  if(pg){
+    // new buffers go into bucket h; they are unused and the
+    // oldest, so the search below picks one of them.
+    pg->next = bcache.pages;
+    bcache.pages = pg;
+    bcache.npages++;
+    for(i = 0; i < BUFPERPAGE; i++){
+      pg->buf[i].next = bcache.bucket[h].head;
+      bcache.bucket[h].head = &pg->buf[i];
     }
   }
-  panic("bget: no buffers");
+  if((b = bfind(h, dev, blockno)) != 0){
+    release(&bcache.bucket[h].lock);
+    release(&bcache.evictlock);
+    return b;
+  }
+
+  // Recycle the unused buffer the policy likes least. Keep the
+  // lock of the bucket holding the best candidate so far, so
+  // that no one else can take it.
+  bcache.policy->prepare(nbufs());
+  b = 0;
+  victimpp = 0;
+  vb = -1;
+  for(i = 0; i < NBUCKET; i++){
+    int found = 0;
+
+    if(i != h)
+      acquire(&bcache.bucket[i].lock);
+    for(pp = &bcache.bucket[i].head; *pp; pp = &(*pp)->next){
+      if((*pp)->refcnt == 0 && (b == 0 || bbefore(*pp, b))){
+        b = *pp;
+        victimpp = pp;
+        found = 1;
+      }
+    }
+    if(found){
+      if(vb >= 0 && vb != h)
+        release(&bcache.bucket[vb].lock);
+      vb = i;
+    } else if(i != h){
+      release(&bcache.bucket[i].lock);
+    }
+  }
+  if(b == 0)
+    panic("bget: no buffers");
+
+  // Move it to bucket h.
+  if(vb != h){
+    *victimpp = b->next;
+    release(&bcache.bucket[vb].lock);
+    b->next = bcache.bucket[h].head;
+    bcache.bucket[h].head = b;
+  }
+  if(b->queue)
+    bcache.policy->remove(b);
+  b->dev = dev;
+  b->blockno = blockno;
+  b->valid = 0;
+  b->refcnt = 1;
+  bcache.policy->insert(b);
+  release(&bcache.bucket[h].lock);
+  release(&bcache.evictlock);
+  return b;
+}
+
+// Like bgetref(), but return the buffer locked.
+static struct buf*
+bget(uint dev, uint blockno)
+{
+  struct buf *b;
+
+  b = bgetref(dev, blockno);
+  acquiresleep(&b->lock);
+  return b;
 }
 
 // Return a locked buf with the contents of the indicated block.
@@ -96,58 +297,296 @@ bread(uint dev, uint blockno)
 
   b = bget(dev, blockno);
   if(!b->valid) {
-    virtio_disk_rw(b, 0);
+    // bprefetch() may have started reading it already.
+    disk_wait(b);
+  }
+  if(!b->valid) {
+    disk_rw(b, 0);
     b->valid = 1;
   }
   return b;
 }
 
+// Is dev/blockno cached? Takes no reference.
+static int
+bcached(uint dev, uint blockno)
+{
+  struct buf *b;
+  int h = bhash(dev, blockno);
+
+  acquire(&bcache.bucket[h].lock);
+  for(b = bcache.bucket[h].head; b; b = b->next)
+    if(b->dev == dev && b->blockno == blockno)
+      break;
+  release(&bcache.bucket[h].lock);
+  return b != 0;
+}
+
+// Start reading blocks blockno..blockno+n-1 into the cache,
+// those that are not there already, without waiting for the
+// disk: a later bread() of one waits for its read to finish
+// instead of starting another. Each run of missing blocks, up
+// to MAXSEG long, is read by one disk request.
+// Returns -1 if the disk queue is full.
+int
+bprefetch(uint dev, uint blockno, int n)
+{
+  struct buf *v[MAXSEG], *b;
+  int i, m;
+
+  m = 0;
+  for(i = 0; i < n; i++){
+    b = 0;
+    if(!bcached(dev, blockno+i)){
+      // Claim it while holding the lock, so that no bread() of
+      // the block can start its own read; the reference taken
+      // here keeps the buffer until the read is done. Do not
+      // wait for the lock: the holder may be waiting for a
+      // block in v[], whose read is not started yet. It will
+      // read this block itself.
+      b = bgetref(dev, blockno+i);
+      if(!tryacquiresleep(&b->lock)){
+        bunpin(b);  // drop the reference
+        b = 0;
+      } else if(b->valid || !disk_claim(b)){
+        brelse(b);
+        b = 0;
+      } else {
+        releasesleep(&b->lock);
+        v[m++] = b;
+      }
+    }
+    if(m > 0 && (b == 0 || m == MAXSEG || i == n-1)){
+      if(disk_read_async(v, m) < 0){
+        while(m > 0)
+          bunpin(v[--m]);
+        return -1;
+      }
+      m = 0;
+    }
+  }
+  return 0;
+}
+
 // Write b's contents to disk.  Must be locked.
 void
 bwrite(struct buf *b)
 {
   if(!holdingsleep(&b->lock))
     panic("bwrite");
-  virtio_disk_rw(b, 1);
+  disk_wait(b);
+  disk_rw(b, 1);
+}
+
+// Start writing b's contents to disk, and return without
+// waiting. Must be locked; the caller may brelse() it at once,
+// but must not modify it again until bflush() returns.
+// Writes of adjacent blocks are merged.
+void
+bawrite(struct buf *b)
+{
+  if(!holdingsleep(&b->lock))
+    panic("bawrite");
+  bpin(b);  // keep it cached until the write is done
+  disk_write_async(b);
+}
+
+// Wait for all writes to dev started by bawrite() to reach
+// the disk, and make them durable there.
+void
+bflush(uint dev)
+{
+  disk_barrier(dev);
 }
 
 // Release a locked buffer.
-// Move to the head of the most-recently-used list.
+// If no one else is using it, note when it was last used.
 void
 brelse(struct buf *b)
 {
+  int h;
+
   if(!holdingsleep(&b->lock))
     panic("brelse");
 
   releasesleep(&b->lock);
 
-  acquire(&bcache.lock);
+  h = bhash(b->dev, b->blockno);
+  acquire(&bcache.bucket[h].lock);
   b->refcnt--;
   if (b->refcnt == 0) {
     // no one is waiting for it.
-    b->next->prev = b->prev;
-    b->prev->next = b->next;
-    b->next = bcache.head.next;
-    b->prev = &bcache.head;
-    bcache.head.next->prev = b;
-    bcache.head.next = b;
+    b->lastuse = r_time();
   }
-  
-  release(&bcache.lock);
+  release(&bcache.bucket[h].lock);
 }
 
 void
 bpin(struct buf *b) {
-  acquire(&bcache.lock);
+  int h = bhash(b->dev, b->blockno);
+
+  acquire(&bcache.bucket[h].lock);
   b->refcnt++;
-  release(&bcache.lock);
+  release(&bcache.bucket[h].lock);
 }
 
 void
 bunpin(struct buf *b) {
-  acquire(&bcache.lock);
+  int h = bhash(b->dev, b->blockno);
+
+  acquire(&bcache.bucket[h].lock);
   b->refcnt--;
-  release(&bcache.lock);
+  if(b->refcnt == 0)
+    b->lastuse = r_time();
+  release(&bcache.bucket[h].lock);
 }
 
+// kalloc() shrinker: free up to n pages of unused buffers.
+// Returns the number of pages freed. Called from kalloc(),
+// so it may run with arbitrary locks held, but never any
+// bcache lock (see bnewpage()).
+int
+bshrink(int n)
+{
+  struct bufpage *pg, **pp, *dead;
+  struct buf *b, **bp;
+  int i, freed = 0;
+
+  if(bcache.npages == 0)
+    return 0;
 
+  acquire(&bcache.evictlock);
+  for(i = 0; i < NBUCKET; i++)
+    acquire(&bcache.bucket[i].lock);
+
+  // pick pages none of whose buffers are in use.
+  dead = 0;
+  for(pp = &bcache.pages; (pg = *pp) != 0 && freed < n; ){
+    for(i = 0; i < BUFPERPAGE; i++)
+      if(pg->buf[i].refcnt != 0)
+        break;
+    if(i < BUFPERPAGE){
+      pp = &pg->next;
+      continue;
+    }
+    *pp = pg->next;
+    pg->dying = 1;
+    pg->next = dead;
+    dead = pg;
+    bcache.npages--;
+    freed++;
+  }
+
+  // unhook their buffers from the buckets.
+  for(i = 0; freed > 0 && i < NBUCKET; i++){
+    for(bp = &bcache.bucket[i].head; (b = *bp) != 0; ){
+      if((b < bcache.buf || b >= bcache.buf+NBUF) &&
+         ((struct bufpage*)PGROUNDDOWN((uint64)b))->dying){
+        if(b->queue)
+          bcache.policy->remove(b);
+        *bp = b->next;
+      } else
+        bp = &b->next;
+    }
+  }
+
+  for(i = NBUCKET-1; i >= 0; i--)
+    release(&bcache.bucket[i].lock);
+  release(&bcache.evictlock);
+
+  while((pg = dead) != 0){
+    dead = pg->next;
+    kfree(pg);
+  }
+  return freed;
+}
+
+// Hand b's block, if any, to a new policy.
+static void
+brequeue(struct buf *b)
+{
+  if(b->queue){
+    b->queue = 0;
+    bcache.policy->insert(b);
+  }
+}
+
+// Switch to replacement policy p (BPOL_*), if p is not -1.
+// Returns the previous one, or -1 if p is no good.
+int
+bsetpolicy(int p)
+{
+  struct bpolicy *old;
+  struct bufpage *pg;
+  struct buf *b;
+  int i;
+
+  if(p < -1 || p >= NELEM(policies))
+    return -1;
+  acquire(&bcache.evictlock);
+  old = bcache.policy;
+  if(p >= 0 && policies[p] != old){
+    // the new policy sees the cached blocks as if they had
+    // all just missed.
+    bcache.policy = policies[p];
+    bcache.policy->reset();
+    for(b = bcache.buf; b < bcache.buf+NBUF; b++)
+      brequeue(b);
+    for(pg = bcache.pages; pg; pg = pg->next)
+      for(i = 0; i < BUFPERPAGE; i++)
+        brequeue(&pg->buf[i]);
+  }
+  release(&bcache.evictlock);
+  for(i = 0; i < NELEM(policies); i++)
+    if(policies[i] == old)
+      return i;
+  return -1;
+}
+
+// Let the cache grow by n buffers beyond NBUF whatever its
+// limit, since the log may keep that many pinned.
+void
+breserve(int n)
+{
+  acquire(&bcache.evictlock);
+  bcache.reserve = n;
+  release(&bcache.evictlock);
+}
+
+// Limit the cache to max buffers (0: no limit), if max is not
+// -1, giving back what it can. Returns the previous limit.
+int
+bsetmax(int max)
+{
+  int old, extra;
+
+  if(max < -1)
+    return -1;
+  acquire(&bcache.evictlock);
+  old = bcache.maxbufs;
+  if(max >= 0)
+    bcache.maxbufs = max;
+  extra = 0;
+  if(max > 0 && max < NBUF + bcache.reserve)
+    max = NBUF + bcache.reserve;
+  if(max > 0 && nbufs() > max)
+    extra = (nbufs() - max + BUFPERPAGE - 1) / BUFPERPAGE;
+  release(&bcache.evictlock);
+  if(extra > 0)
+    bshrink(extra);
+  return old;
+}
+
+// Format the cache's counters for the statistics device.
+int
+statsbcache(char *buf, int sz)
+{
+  int i, n;
+
+  n = snprintf(buf, sz, "bcache hits %l misses %l bufs %d\n",
+               bcache.hits, bcache.misses, nbufs());
+  for(i = 0; i < NELEM(policies); i++)
+    n += snprintf(buf+n, sz-n, "bcache policy %s hits %l misses %l\n",
+                  policies[i]->name, policies[i]->hits, policies[i]->misses);
+  return n;
+}
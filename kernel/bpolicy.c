@@ -0,0 +1,150 @@
+// Buffer cache replacement policies.
+//
+// When bget() must recycle a buffer, it asks the current policy
+// which of the unused ones should go (see struct bpolicy in
+// buf.h). A policy keeps its per-buffer state in b->queue and
+// b->qtime; all of its hooks run with bcache.evictlock held.
+
+#include "types.h"
+#include "param.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "riscv.h"
+#include "fs.h"
+#include "buf.h"
+#include "defs.h"
+
+// LRU: recycle the buffer released longest ago. A scan of a
+// large file pushes out everything else.
+
+static void
+lruinsert(struct buf *b)
+{
+  b->queue = 1;
+}
+
+static void
+lruremove(struct buf *b)
+{
+}
+
+static void
+lrureset(void)
+{
+}
+
+static void
+lruprepare(int nbuf)
+{
+}
+
+static int
+lrubefore(struct buf *a, struct buf *b)
+{
+  return a->lastuse < b->lastuse;
+}
+
+struct bpolicy lrupolicy = {
+  "lru", lrureset, lruinsert, lruremove, lruprepare, lrubefore,
+};
+
+// 2Q (Johnson and Shasha, VLDB '94). A block that misses goes
+// into A1in, a FIFO queue, where further hits do not move it.
+// When it leaves A1in, its number is remembered in A1out; if it
+// misses again while still remembered there, it has proved it
+// is re-used, and goes into Am, which is LRU. Buffers are taken
+// from A1in while it holds more than a quarter of the cache, so
+// a scan, whose blocks each miss once, only churns A1in.
+
+#define A1IN 1
+#define AM   2
+#define NGHOST 256  // most block numbers A1out remembers
+
+static struct {
+  int na1;          // buffers in A1in
+  int kin;          // A1in's share of the cache
+  int kout;         // how many blocks A1out remembers
+  int evicta1;      // take from A1in rather than Am?
+
+  // A1out, a FIFO ring of block numbers.
+  struct {
+    uint dev;       // 0 if forgotten
+    uint blockno;
+  } ghost[NGHOST];
+  int ghead;        // oldest entry
+  int nghost;
+} twoq;
+
+static int
+twoqghost(uint dev, uint blockno)
+{
+  for(int i = 0; i < twoq.nghost; i++){
+    int g = (twoq.ghead + i) % NGHOST;
+    if(twoq.ghost[g].dev == dev && twoq.ghost[g].blockno == blockno){
+      twoq.ghost[g].dev = 0;
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static void
+twoqinsert(struct buf *b)
+{
+  b->qtime = r_time();
+  if(twoqghost(b->dev, b->blockno)){
+    b->queue = AM;
+  } else {
+    b->queue = A1IN;
+    twoq.na1++;
+  }
+}
+
+static void
+twoqremove(struct buf *b)
+{
+  int g;
+
+  if(b->queue != A1IN)
+    return;
+  twoq.na1--;
+  while(twoq.nghost > 0 && twoq.nghost >= twoq.kout){
+    twoq.ghead = (twoq.ghead + 1) % NGHOST;
+    twoq.nghost--;
+  }
+  if(twoq.kout == 0)
+    return;
+  g = (twoq.ghead + twoq.nghost++) % NGHOST;
+  twoq.ghost[g].dev = b->dev;
+  twoq.ghost[g].blockno = b->blockno;
+}
+
+static void
+twoqreset(void)
+{
+  twoq.na1 = 0;
+  twoq.ghead = 0;
+  twoq.nghost = 0;
+}
+
+static void
+twoqprepare(int nbuf)
+{
+  twoq.kin = nbuf / 4;
+  twoq.kout = nbuf / 2 < NGHOST ? nbuf / 2 : NGHOST;
+  twoq.evicta1 = twoq.na1 > twoq.kin;
+}
+
+static int
+twoqbefore(struct buf *a, struct buf *b)
+{
+  if(a->queue != b->queue)
+    return a->queue == (twoq.evicta1 ? A1IN : AM);
+  if(a->queue == A1IN)
+    return a->qtime < b->qtime;
+  return a->lastuse < b->lastuse;
+}
+
+struct bpolicy twoqpolicy = {
+  "2q", twoqreset, twoqinsert, twoqremove, twoqprepare, twoqbefore,
+};
@@ -1,12 +1,28 @@
 struct buf {
   int valid;   // has data been read from disk?
-  int disk;    // does disk "own" buf?
+  int disk;    // is buf queued for, or owned by, the disk?
   uint dev;
   uint blockno;
   struct sleeplock lock;
   uint refcnt;
-  struct buf *prev; // LRU cache list
-  struct buf *next;
+  uint64 lastuse;   // when refcnt last fell to 0, for LRU eviction
+  struct buf *next; // hash bucket list
+  struct buf *qnext; // next buffer in the same disk request
+  int queue;        // replacement policy's list; 0 if holding no block
+  uint64 qtime;     // when it joined that list
   uchar data[BSIZE];
 };
 
+// A buffer replacement policy (bpolicy.c). Its hooks are called
+// with bcache.evictlock held.
+struct bpolicy {
+  char *name;
+  void (*reset)(void);          // forget all buffers
+  void (*insert)(struct buf*);  // b now holds a block that missed
+  void (*remove)(struct buf*);  // b's block is leaving the cache
+  void (*prepare)(int nbuf);    // a search for a victim is starting
+  int (*before)(struct buf*, struct buf*); // recycle a sooner than b?
+  uint64 hits;                  // lookups while this was the policy
+  uint64 misses;
+};
+
@@ -1,21 +1,39 @@
+struct bdev;
 struct buf;
+struct bpolicy;
 struct context;
 struct file;
 struct inode;
+struct ioreq;
+struct lockstat;
 struct pipe;
 struct proc;
+struct rwspinlock;
 struct spinlock;
 struct sleeplock;
 struct stat;
 struct superblock;
+struct timer;
 
 // bio.c
 void            binit(void);
 struct buf*     bread(uint, uint);
+int             bprefetch(uint, uint, int);
 void            brelse(struct buf*);
 void            bwrite(struct buf*);
+void            bawrite(struct buf*);
+void            bflush(uint);
 void            bpin(struct buf*);
 void            bunpin(struct buf*);
+int             bshrink(int);
+int             statsbcache(char*, int);
+int             bsetpolicy(int);
+int             bsetmax(int);
+void            breserve(int);
+
+// bpolicy.c
+extern struct bpolicy lrupolicy;
+extern struct bpolicy twoqpolicy;
 
 // console.c
 void            consoleinit(void);
@@ -56,18 +74,39 @@ void            itrunc(struct inode*);
 
 // ramdisk.c
 void            ramdiskinit(void);
-void            ramdiskintr(void);
-void            ramdiskrw(struct buf*);
+
+// iosched.c
+void            ioschedinit(void);
+void            disk_rw(struct buf*, int);
+int             disk_claim(struct buf*);
+int             disk_read_async(struct buf**, int);
+void            disk_wait(struct buf*);
+void            disk_write_async(struct buf*);
+void            disk_flush(uint);
+void            disk_barrier(uint);
+void            disk_done(struct ioreq*);
+int             disk_setpoll(int);
+void            bdevregister(uint, struct bdev*);
+int             statsdisk(char*, int);
 
 // kalloc.c
 void*           kalloc(void);
 void            kfree(void *);
 void            kinit(void);
+void            kshrinkadd(int (*)(int));
+int             kfreepages(void);
+
+// ktrace.c
+extern int      ktracemask;
+void            ktraceinit(void);
+void            ktracerecord(int, uint64, uint64);
+#define KTRACE(type, arg0, arg1) \
+  do { if(ktracemask & (1 << (type))) ktracerecord((type), (arg0), (arg1)); } while(0)
 
 // log.c
 void            initlog(int, struct superblock*);
 void            log_write(struct buf*);
-void            begin_op(void);
+void            begin_op(int);
 void            end_op(void);
 
 // pipe.c
@@ -81,6 +120,11 @@ void            printf(char*, ...);
 void            panic(char*) __attribute__((noreturn));
 void            printfinit(void);
 
+// prof.c
+extern uint64   profperiod;
+void            profinit(void);
+void            profintr(uint64, uint64, int);
+
 // proc.c
 int             cpuid(void);
 void            exit(int);
@@ -90,6 +134,7 @@ void            proc_mapstacks(pagetable_t);
 pagetable_t     proc_pagetable(struct proc *);
 void            proc_freepagetable(pagetable_t, uint64);
 int             kill(int);
+struct proc*    findproc(int);
 struct cpu*     mycpu(void);
 struct cpu*     getmycpu(void);
 struct proc*    myproc();
@@ -97,9 +142,11 @@ void            procinit(void);
 void            scheduler(void) __attribute__((noreturn));
 void            sched(void);
 void            sleep(void*, struct spinlock*);
+int             sleepuntil(void*, struct spinlock*, uint64);
 void            userinit(void);
 int             wait(uint64);
 void            wakeup(void*);
+int             anyrunnable(void);
 void            yield(void);
 int             either_copyout(int user_dst, uint64 dst, void *src, uint64 len);
 int             either_copyin(void *dst, int user_src, uint64 src, uint64 len);
@@ -112,15 +159,47 @@ void            swtch(struct context*, struct context*);
 void            acquire(struct spinlock*);
 int             holding(struct spinlock*);
 void            initlock(struct spinlock*, char*);
+void            initlocktype(struct spinlock*, char*, int);
+void            initlocknostat(struct spinlock*, char*);
+void            freelock(struct spinlock*);
 void            release(struct spinlock*);
 void            push_off(void);
 void            pop_off(void);
+void            lockstatadd(char*, char*, struct lockstat*);
+void            lockstatgroup(char*, char*, struct lockstat*, int, int);
+void            lockstatremove(struct lockstat*);
+void            lockstatreset(void);
+int             statslock(char*, int);
+
+// rwlock.c
+void            initrwlock(struct rwspinlock*, char*);
+void            acquireread(struct rwspinlock*);
+void            releaseread(struct rwspinlock*);
+void            acquirewrite(struct rwspinlock*);
+void            releasewrite(struct rwspinlock*);
+
+// rcu.c
+void            rcu_read_lock(void);
+void            rcu_read_unlock(void);
+void            rcu_qs(void);
+void            synchronize_rcu(void);
 
 // sleeplock.c
 void            acquiresleep(struct sleeplock*);
+int             tryacquiresleep(struct sleeplock*);
 void            releasesleep(struct sleeplock*);
 int             holdingsleep(struct sleeplock*);
 void            initsleeplock(struct sleeplock*, char*);
+void            initsleeplocknostat(struct sleeplock*, char*);
+
+// sprintf.c
+int             snprintf(char*, int, char*, ...);
+
+// stats.c
+void            statsinit(void);
+
+// stripe.c
+void            stripeinit(uint, struct bdev**, int);
 
 // string.c
 int             memcmp(const void*, const void*, uint);
@@ -139,11 +218,18 @@ int             fetchstr(uint64, char*, int);
 int             fetchaddr(uint64, uint64*);
 void            syscall();
 
+// timer.c
+void            timerinithart(void);
+void            timerset(struct timer*, uint64, void (*)(void*), void*);
+int             timercancel(struct timer*);
+int             timerintr(void);
+void            timeridle(void);
+void            timerresume(void);
+void            timerkick(void);
+void            timerpoke(int);
+
 // trap.c
-extern uint     ticks;
-void            trapinit(void);
 void            trapinithart(void);
-extern struct spinlock tickslock;
 void            usertrapret(void);
 
 // uart.c
@@ -179,8 +265,7 @@ void            plic_complete(int);
 
 // virtio_disk.c
 void            virtio_disk_init(void);
-void            virtio_disk_rw(struct buf *, int);
-void            virtio_disk_intr(void);
+void            virtio_disk_intr(int);
 
 // number of elements in fixed-size array
 #define NELEM(x) (sizeof(x)/sizeof((x)[0]))
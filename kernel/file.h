@@ -18,6 +18,7 @@ struct inode {
   uint dev;           // Device number
   uint inum;          // Inode number
   int ref;            // Reference count
+  uint64 gp;          // itable.gpstart when ref last fell to 0
   struct sleeplock lock; // protects everything below here
   int valid;          // inode has been read from disk?
 
@@ -27,6 +28,10 @@ struct inode {
   short nlink;
   uint size;
   uint addrs[NDIRECT+1];
+
+  uint ranext;        // read-ahead: block a sequential read asks for next
+  uint rawin;         // read-ahead window, in blocks; 0 if not sequential
+  uint raend;         // blocks before this one have been prefetched
 };
 
 // map major device number to device functions.
@@ -38,3 +43,4 @@ struct devsw {
 extern struct devsw devsw[];
 
 #define CONSOLE 1
+#define STATS   2
@@ -15,6 +15,7 @@
 #include "param.h"
 #include "stat.h"
 #include "spinlock.h"
+#include "rwlock.h"
 #include "proc.h"
 #include "sleeplock.h"
 #include "fs.h"
@@ -162,18 +163,27 @@ bfree(int dev, uint b)
 // have locked the inodes involved; this lets callers create
 // multi-step atomic operations.
 //
-// The itable.lock spin-lock protects the allocation of itable
-// entries. Since ip->ref indicates whether an entry is free,
-// and ip->dev and ip->inum indicate which i-node an entry
-// holds, one must hold itable.lock while using any of those fields.
+// The itable.lock reader-writer lock protects the allocation of
+// itable entries. Since ip->ref indicates whether an entry is free,
+// and ip->dev and ip->inum indicate which i-node an entry holds,
+// changing ip->dev or ip->inum, or taking ip->ref to or from zero,
+// needs the write lock. Lookups take no lock at all: iget() scans
+// the table in an RCU read-side section (rcu.c), and takes a
+// reference only while ip->ref is above zero. ip->ref is updated
+// atomically, so that such lookups and idup()/iput() can adjust it
+// concurrently. An entry whose ref fell to zero is only recycled
+// once a grace period has passed since, so that a lookup cannot
+// match it by its old dev and inum after it holds another inode.
 //
 // An ip->lock sleep-lock protects all ip-> fields other than ref,
 // dev, and inum.  One must hold ip->lock in order to
 // read or write that inode's ip->valid, ip->size, ip->type, &c.
 
 struct {
-  struct spinlock lock;
+  struct rwspinlock lock;
   struct inode inode[NINODE];
+  uint64 gpstart;   // grace periods iget() has started
+  uint64 gpdone;    // the last of them known to have ended
 } itable;
 
 void
@@ -181,7 +191,7 @@ iinit()
 {
   int i = 0;
   
-  initlock(&itable.lock, "itable");
+  initrwlock(&itable.lock, "itable");
   for(i = 0; i < NINODE; i++) {
     initsleeplock(&itable.inode[i].lock, "inode");
   }
@@ -236,6 +246,25 @@ iupdate(struct inode *ip)
   brelse(bp);
 }
 
+// Wait for a grace period, after which the entries whose ref
+// fell to zero before it started may be recycled.
+static void
+igrace(void)
+{
+  uint64 gp;
+
+  acquirewrite(&itable.lock);
+  gp = ++itable.gpstart;
+  releasewrite(&itable.lock);
+
+  synchronize_rcu();
+
+  acquirewrite(&itable.lock);
+  if(gp > itable.gpdone)
+    itable.gpdone = gp;
+  releasewrite(&itable.lock);
+}
+
 // Find the inode with number inum on device dev
 // and return the in-memory copy. Does not lock
 // the inode and does not read it from disk.
@@ -243,31 +272,64 @@ static struct inode*
 iget(uint dev, uint inum)
 {
   struct inode *ip, *empty;
+  int ref, wait;
 
-  acquire(&itable.lock);
-
-  // Is the inode already in the table?
-  empty = 0;
+  // Is the inode already in the table? An entry cannot be
+  // recycled while we are in the read-side section, so if
+  // its ref is still the one we saw, it still holds inum.
+  rcu_read_lock();
   for(ip = &itable.inode[0]; ip < &itable.inode[NINODE]; ip++){
-    if(ip->ref > 0 && ip->dev == dev && ip->inum == inum){
-      ip->ref++;
-      release(&itable.lock);
-      return ip;
+    while((ref = ip->ref) > 0){
+      __sync_synchronize();  // read ref before dev and inum
+      if(ip->dev != dev || ip->inum != inum)
+        break;
+      if(__sync_bool_compare_and_swap(&ip->ref, ref, ref+1)){
+        rcu_read_unlock();
+        return ip;
+      }
     }
-    if(empty == 0 && ip->ref == 0)    // Remember empty slot.
-      empty = ip;
+  }
+  rcu_read_unlock();
+
+  // Not there. Look again with the write lock held, since
+  // another process may have brought it in meanwhile.
+  for(;;){
+    acquirewrite(&itable.lock);
+    empty = 0;
+    wait = 0;
+    for(ip = &itable.inode[0]; ip < &itable.inode[NINODE]; ip++){
+      if(ip->ref > 0 && ip->dev == dev && ip->inum == inum){
+        __sync_fetch_and_add(&ip->ref, 1);
+        releasewrite(&itable.lock);
+        return ip;
+      }
+      if(empty == 0 && ip->ref == 0){    // Remember empty slot.
+        // never used, or free since before a grace period?
+        if(ip->inum == 0 || ip->gp < itable.gpdone)
+          empty = ip;
+        else
+          wait = 1;
+      }
+    }
+    if(empty)
+      break;
+    releasewrite(&itable.lock);
+    if(!wait)
+      panic("iget: no inodes");
+    igrace();
   }
 
   // Recycle an inode entry.
-  if(empty == 0)
-    panic("iget: no inodes");
-
   ip = empty;
   ip->dev = dev;
   ip->inum = inum;
-  ip->ref = 1;
   ip->valid = 0;
-  release(&itable.lock);
+  ip->ranext = 0;
+  ip->rawin = 0;
+  ip->raend = 0;
+  __sync_synchronize();  // lookups that see ref > 0 see dev and inum
+  ip->ref = 1;
+  releasewrite(&itable.lock);
 
   return ip;
 }
@@ -277,9 +339,8 @@ iget(uint dev, uint inum)
 struct inode*
 idup(struct inode *ip)
 {
-  acquire(&itable.lock);
-  ip->ref++;
-  release(&itable.lock);
+  // the caller's reference keeps ref above zero.
+  __sync_fetch_and_add(&ip->ref, 1);
   return ip;
 }
 
@@ -332,7 +393,15 @@ iunlock(struct inode *ip)
 void
 iput(struct inode *ip)
 {
-  acquire(&itable.lock);
+  int ref;
+
+  // Not the last reference: no need for the lock.
+  while((ref = ip->ref) > 1){
+    if(__sync_bool_compare_and_swap(&ip->ref, ref, ref-1))
+      return;
+  }
+
+  acquirewrite(&itable.lock);
 
   if(ip->ref == 1 && ip->valid && ip->nlink == 0){
     // inode has no links and no other references: truncate and free.
@@ -341,7 +410,7 @@ iput(struct inode *ip)
     // so this acquiresleep() won't block (or deadlock).
     acquiresleep(&ip->lock);
 
-    release(&itable.lock);
+    releasewrite(&itable.lock);
 
     itrunc(ip);
     ip->type = 0;
@@ -350,11 +419,12 @@ iput(struct inode *ip)
 
     releasesleep(&ip->lock);
 
-    acquire(&itable.lock);
+    acquirewrite(&itable.lock);
   }
 
-  ip->ref--;
-  release(&itable.lock);
+  if(__sync_sub_and_fetch(&ip->ref, 1) == 0)
+    ip->gp = itable.gpstart;  // see iget()
+  releasewrite(&itable.lock);
 }
 
 // Common idiom: unlock, then put.
@@ -433,6 +503,7 @@ itrunc(struct inode *ip)
   }
 
   ip->size = 0;
+  ip->raend = 0;
   iupdate(ip);
 }
 
@@ -448,6 +519,51 @@ stati(struct inode *ip, struct stat *st)
   st->size = ip->size;
 }
 
+// Read-ahead. Before readi() copies out blocks first..last, it
+// starts reading them all, so that runs of them that are
+// consecutive on disk go to the disk as single requests. A read
+// that starts where the last one ended, in the same block or the
+// next, is taken as sequential, and also starts reading the next
+// rawin blocks past its end. The window starts at RAMIN blocks
+// and doubles with each further sequential read, up to RAMAX;
+// any other read turns it off.
+#define RAMIN 4
+#define RAMAX 32
+
+// Caller must hold ip->lock.
+static void
+readahead(struct inode *ip, uint first, uint last)
+{
+  uint bn, end, nblocks, addr, n;
+
+  if(first != ip->ranext && first + 1 != ip->ranext){
+    ip->rawin = 0;
+    ip->raend = 0;
+  } else if(ip->rawin == 0){
+    ip->rawin = RAMIN;
+  } else if(ip->rawin < RAMAX){
+    ip->rawin *= 2;
+  }
+  ip->ranext = last + 1;
+
+  nblocks = (ip->size + BSIZE - 1) / BSIZE;
+  end = min(last + 1 + ip->rawin, nblocks);
+  bn = ip->raend > first ? ip->raend : first;
+  if(bn == first && end <= first + 1)
+    return;  // just the one block; bread() will do
+  while(bn < end){
+    // bmap() does not allocate blocks inside the file.
+    addr = bmap(ip, bn);
+    for(n = 1; bn + n < end && n < MAXSEG; n++)
+      if(bmap(ip, bn + n) != addr + n)
+        break;
+    if(bprefetch(ip->dev, addr, n) < 0)
+      break;  // disk queue full; try again on the next read
+    bn += n;
+  }
+  ip->raend = bn;
+}
+
 // Read data from inode.
 // Caller must hold ip->lock.
 // If user_dst==1, then dst is a user virtual address;
@@ -462,6 +578,8 @@ readi(struct inode *ip, int user_dst, uint64 dst, uint off, uint n)
     return 0;
   if(off + n > ip->size)
     n = ip->size - off;
+  if(n > 0)
+    readahead(ip, off/BSIZE, (off+n-1)/BSIZE);
 
   for(tot=0; tot<n; tot+=m, off+=m, dst+=m){
     bp = bread(ip->dev, bmap(ip, off/BSIZE));
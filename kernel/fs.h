@@ -50,6 +50,17 @@ struct dinode {
 // Block of free map containing bit for block b
 #define BBLOCK(b, sb) ((b)/BPB + sb.bmapstart)
 
+// Log blocks that a file system operation may write, which it
+// reserves with begin_op(). Any of them may allocate or free
+// blocks under every bitmap block, and drop the last reference
+// to an unlinked inode, freeing it.
+#define NBITMAP       (FSSIZE/BPB + 1)
+#define OP_IPUT       (1 + NBITMAP)  // the freed inode
+#define OP_UNLINK     (3 + NBITMAP)  // dir entry, dir inode, inode
+#define OP_LINK       (4 + NBITMAP)  // inode, dir entry, indirect, dir inode
+#define OP_CREATE     (5 + NBITMAP)  // OP_LINK, and the new dir's first block
+#define OP_WRITE(nb)  ((nb) + 2 + NBITMAP)  // nb data blocks, indirect, inode
+
 // Directory is a file containing a sequence of dirent structures.
 #define DIRSIZ 14
 
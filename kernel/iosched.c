@@ -0,0 +1,567 @@
+// Disk I/O scheduler.
+//
+// bio.c hands disk transfers to this layer rather than to the
+// driver. Each disk has a queue of requests, sorted by block
+// number. A transfer that continues or precedes a queued request
+// of the same kind is merged into it, up to MAXSEG blocks, so
+// that it goes to the device as one request. No more than QDEPTH
+// requests are sent at a time; the rest wait in the queue, which
+// the elevator serves in one direction, sweeping up the disk and
+// starting again from the bottom, unless some request has waited
+// past its deadline, in which case the oldest goes first. Reads
+// have a shorter deadline than writes, since someone is usually
+// waiting for them.
+//
+// Asynchronous writes (bawrite()) are held back in the queue
+// until disk_barrier(), or until NPLUG requests of them pile up,
+// so that they have a chance to merge.
+//
+// In polling mode (sysctl CTL_DISKPOLL), a process that must wait
+// for a transfer first spins, reaping completions itself, for a
+// window of twice the recent average latency, and only sleeps if
+// the transfer has not finished by then. That saves the interrupt
+// and the trip through the scheduler when the device is quick.
+//
+// Each disk's driver registers a struct bdev (bdev.h) with
+// bdevregister(); the scheduler sends requests through its
+// submit hook, and the driver hands them back, done, to
+// disk_done(). b->disk is set while a buffer is queued or in
+// flight; all of it is protected by the queue's lock.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "buf.h"
+#include "iosched.h"
+#include "bdev.h"
+#include "defs.h"
+
+#define NIOREQ 128          // requests queued or in flight, all disks
+#define QDEPTH 16           // most requests in flight per disk
+#define NPLUG 32            // most writes held back
+#define READEXPIRE 500000   // deadline for reads: 50ms of CLINT_MTIME
+#define WRITEEXPIRE 5000000 // and for writes: 500ms
+#define NLATHIST 24         // latency histogram buckets
+#define POLLMAX 10000       // longest poll window: 1ms
+
+struct ioqueue {
+  struct spinlock lock;
+  struct bdev *bdev;    // the driver, or 0 if there is no such disk
+  uint size;            // blocks on the disk
+  struct ioreq *head;   // queued, sorted by block number
+  uint pos;             // where the elevator is
+  int nqueued;
+  int nheld;            // held writes
+  int inflight;
+  int nwriting;         // asynchronous writes not yet done
+
+  uint64 nrequest;      // requests sent
+  uint64 nblock;        // blocks they carried
+  uint64 backmerge;     // transfers added to the end of a request
+  uint64 frontmerge;    // transfers added to the front
+  uint64 nlate;         // requests sent after their deadline
+  int maxqueued;
+  int maxinflight;
+  uint64 lat[NLATHIST]; // lat[i]: requests that took [2^i, 2^(i+1)) CLINT_MTIME ticks
+
+  uint64 pollavg;       // moving average of polled waits, in CLINT_MTIME ticks
+  uint64 npoll;         // waits that polled
+  uint64 npollhit;      // and were done before the window closed
+};
+
+static int diskpoll;    // poll before sleeping?
+
+static struct {
+  struct spinlock lock; // protects free
+  struct ioreq req[NIOREQ];
+  struct ioreq *free;
+  struct ioqueue q[NDISK];
+} iosched;
+
+void
+ioschedinit(void)
+{
+  initlock(&iosched.lock, "iosched");
+  for(int i = 0; i < NIOREQ; i++){
+    iosched.req[i].next = iosched.free;
+    iosched.free = &iosched.req[i];
+  }
+  for(int i = 0; i < NDISK; i++){
+    initlock(&iosched.q[i].lock, "ioqueue");
+    iosched.q[i].pollavg = POLLMAX / 4;
+  }
+}
+
+static struct ioqueue*
+getq(uint dev)
+{
+  if(dev < ROOTDEV || dev >= ROOTDEV + NDISK || iosched.q[dev - ROOTDEV].bdev == 0)
+    panic("iosched: no such disk");
+  return &iosched.q[dev - ROOTDEV];
+}
+
+// Make d the driver of disk dev.
+void
+bdevregister(uint dev, struct bdev *d)
+{
+  struct ioqueue *q;
+
+  if(dev < ROOTDEV || dev >= ROOTDEV + NDISK)
+    panic("bdevregister");
+  q = &iosched.q[dev - ROOTDEV];
+  acquire(&q->lock);
+  if(q->bdev)
+    panic("bdevregister: twice");
+  q->bdev = d;
+  q->size = d->capacity(d);
+  release(&q->lock);
+}
+
+static struct ioreq*
+reqalloc(void)
+{
+  struct ioreq *r;
+
+  acquire(&iosched.lock);
+  if((r = iosched.free) != 0)
+    iosched.free = r->next;
+  release(&iosched.lock);
+  return r;
+}
+
+static void
+reqfree(struct ioreq *r)
+{
+  acquire(&iosched.lock);
+  r->next = iosched.free;
+  iosched.free = r;
+  release(&iosched.lock);
+}
+
+// Try to add the n buffers of v to a queued request, at its
+// end or its front. Caller must hold q->lock.
+static int
+merge(struct ioqueue *q, struct buf **v, int n, int write, int async)
+{
+  struct ioreq *r;
+  int i;
+
+  for(r = q->head; r; r = r->next){
+    if(r->write != write || r->async != async || r->n + n > MAXSEG)
+      continue;
+    if(r->blockno + r->n == v[0]->blockno){
+      for(i = 0; i < n; i++){
+        r->tail->qnext = v[i];
+        r->tail = v[i];
+      }
+      r->tail->qnext = 0;
+      r->n += n;
+      q->backmerge++;
+    } else if(v[n-1]->blockno + 1 == r->blockno){
+      v[n-1]->qnext = r->head;
+      for(i = n-1; i > 0; i--)
+        v[i-1]->qnext = v[i];
+      r->head = v[0];
+      r->blockno = v[0]->blockno;
+      r->n += n;
+      q->frontmerge++;
+    } else {
+      continue;
+    }
+    // r keeps its deadline, which is the earlier.
+    return 1;
+  }
+  return 0;
+}
+
+// Queue the n buffers of v, which hold consecutive blocks, as
+// a new request r. Caller must hold q->lock.
+static void
+enqueue(struct ioqueue *q, struct ioreq *r, struct buf **v, int n, int write, int async)
+{
+  struct ioreq **pp;
+  int i;
+
+  r->dev = v[0]->dev;
+  r->blockno = v[0]->blockno;
+  r->n = n;
+  r->head = v[0];
+  for(i = 0; i < n-1; i++)
+    v[i]->qnext = v[i+1];
+  r->tail = v[n-1];
+  r->tail->qnext = 0;
+  r->write = write;
+  r->async = async;
+  r->done = disk_done;
+  r->held = write && async;
+  r->queued = 1;
+  r->arrive = r_time();
+  r->deadline = r->arrive + (write ? WRITEEXPIRE : READEXPIRE);
+  for(pp = &q->head; *pp && (*pp)->blockno < r->blockno; pp = &(*pp)->next)
+    ;
+  r->next = *pp;
+  *pp = r;
+  if(r->held)
+    q->nheld++;
+  if(++q->nqueued > q->maxqueued)
+    q->maxqueued = q->nqueued;
+}
+
+// Choose the next request to send, or 0.
+// Caller must hold q->lock.
+static struct ioreq*
+pick(struct ioqueue *q)
+{
+  struct ioreq *r, *oldest = 0, *up = 0, *first = 0;
+  uint64 now = r_time();
+
+  for(r = q->head; r; r = r->next){
+    if(r->held)
+      continue;
+    if(oldest == 0 || r->arrive < oldest->arrive)
+      oldest = r;
+    if(first == 0)
+      first = r;
+    if(up == 0 && r->blockno >= q->pos)
+      up = r;
+  }
+  if(oldest && oldest->deadline <= now)
+    return oldest;
+  return up ? up : first;
+}
+
+static void complete(struct ioqueue*, struct ioreq*);
+
+// Send queued requests while the device has room for them.
+// Caller must hold q->lock.
+static void
+dispatch(struct ioqueue *q)
+{
+  struct ioreq *r, **pp;
+  int done;
+
+  while(q->inflight < QDEPTH && (r = pick(q)) != 0){
+    // take r off the queue first, since a device that finishes
+    // it at once (a ram disk) lets complete() free it.
+    for(pp = &q->head; *pp != r; pp = &(*pp)->next)
+      ;
+    *pp = r->next;
+    r->queued = 0;
+    q->nqueued--;
+    if((done = q->bdev->submit(q->bdev, r)) < 0){
+      // ring full; disk_done() will try again.
+      r->queued = 1;
+      r->next = *pp;
+      *pp = r;
+      q->nqueued++;
+      break;
+    }
+    if(r->deadline <= r_time())
+      q->nlate++;
+    q->pos = r->blockno + r->n;
+    q->nrequest++;
+    q->nblock += r->n;
+    if(++q->inflight > q->maxinflight)
+      q->maxinflight = q->inflight;
+    if(done)
+      complete(q, r);
+  }
+}
+
+// Let the held writes go. Caller must hold q->lock.
+static void
+unplug(struct ioqueue *q)
+{
+  struct ioreq *r;
+
+  if(q->nheld == 0)
+    return;
+  for(r = q->head; r; r = r->next)
+    r->held = 0;
+  q->nheld = 0;
+  dispatch(q);
+}
+
+// Queue the n buffers of v, which hold consecutive blocks and
+// are not otherwise queued, merging them into a queued request
+// if possible. Returns -1 if there is no request to put them in
+// and nowait is set. Caller must hold q->lock.
+static int
+submit(struct ioqueue *q, struct buf **v, int n, int write, int async, int nowait)
+{
+  struct ioreq *r;
+  int i;
+
+  if(v[n-1]->blockno >= q->size)
+    panic("iosched: block out of range");
+  for(i = 0; i < n; i++)
+    v[i]->disk = 1;
+  if(async && write)
+    q->nwriting += n;
+  if(!merge(q, v, n, write, async)){
+    while((r = reqalloc()) == 0){
+      if(nowait){
+        for(i = 0; i < n; i++)
+          v[i]->disk = 0;
+        if(async && write)
+          q->nwriting -= n;
+        return -1;
+      }
+      sleep(&iosched.free, &q->lock);
+    }
+    enqueue(q, r, v, n, write, async);
+  }
+  if(q->nheld >= NPLUG)
+    unplug(q);
+  else
+    dispatch(q);
+  return 0;
+}
+
+// Wait for b's transfer to finish, polling first if that is
+// likely to pay off. Caller must hold q->lock.
+static void
+waitdone(struct ioqueue *q, struct buf *b)
+{
+  uint64 t0, t, window;
+  int hit;
+
+  if(diskpoll && b->disk == 1 && q->bdev->poll){
+    window = 2 * q->pollavg;
+    if(window > POLLMAX)
+      window = 0;  // the device is slow; polling would not pay
+    release(&q->lock);
+    t0 = r_time();
+    q->bdev->pollstart(q->bdev);
+    while(b->disk == 1 && r_time() - t0 < window)
+      q->bdev->poll(q->bdev);
+    q->bdev->pollend(q->bdev);
+    acquire(&q->lock);
+    hit = b->disk == 0;
+    while(b->disk == 1)
+      sleep(b, &q->lock);
+    // learn from every wait, so that a window that has
+    // closed can open again once the device speeds up.
+    t = r_time() - t0;
+    q->pollavg = (7 * q->pollavg + t) / 8;
+    q->npoll++;
+    if(hit)
+      q->npollhit++;
+    return;
+  }
+  while(b->disk == 1)
+    sleep(b, &q->lock);
+}
+
+// Read or write b, and wait for it. b must be locked.
+void
+disk_rw(struct buf *b, int write)
+{
+  struct ioqueue *q = getq(b->dev);
+
+  acquire(&q->lock);
+  submit(q, &b, 1, write, 0, 0);
+  waitdone(q, b);
+  release(&q->lock);
+}
+
+// Reserve b for a read-ahead. b must be locked and not valid.
+// Until the read is queued and done, or cancelled, disk_wait()
+// waits for it, so the caller may release b's lock meanwhile,
+// but must keep a reference to it. Returns 0 if b has a transfer
+// queued or in flight already.
+int
+disk_claim(struct buf *b)
+{
+  struct ioqueue *q = getq(b->dev);
+  int ok;
+
+  acquire(&q->lock);
+  ok = b->disk == 0;
+  b->disk = 1;
+  release(&q->lock);
+  return ok;
+}
+
+// Start reading the n claimed buffers in v, which hold
+// consecutive blocks, without waiting. When the read is done,
+// disk_done() marks them valid and drops their references with
+// bunpin(). Returns -1 if the scheduler is full, in which case
+// the claims are cancelled and the caller must drop the
+// references itself.
+int
+disk_read_async(struct buf **v, int n)
+{
+  struct ioqueue *q = getq(v[0]->dev);
+  int i, r;
+
+  acquire(&q->lock);
+  if((r = submit(q, v, n, 0, 1, 1)) < 0){
+    for(i = 0; i < n; i++)
+      wakeup(v[i]);
+  }
+  release(&q->lock);
+  return r;
+}
+
+// Wait for any transfer of b to finish. b must be locked.
+void
+disk_wait(struct buf *b)
+{
+  struct ioqueue *q = getq(b->dev);
+
+  acquire(&q->lock);
+  if(b->disk == 1)
+    unplug(q);
+  waitdone(q, b);
+  release(&q->lock);
+}
+
+// Queue b to be written, and return without waiting. b must be
+// locked, and the caller must hold a reference to it, which is
+// dropped with bunpin() once the write is done.
+void
+disk_write_async(struct buf *b)
+{
+  struct ioqueue *q = getq(b->dev);
+  struct ioreq *r;
+  struct buf *p;
+
+  acquire(&q->lock);
+  if(b->disk == 1){
+    // already queued? then that write will carry b's current data.
+    for(r = q->head; r; r = r->next){
+      if(!r->write)
+        continue;
+      for(p = r->head; p; p = p->qnext){
+        if(p == b){
+          release(&q->lock);
+          bunpin(b);
+          return;
+        }
+      }
+    }
+    // an earlier transfer of b must finish before it can be reused.
+    unplug(q);
+    while(b->disk == 1)
+      sleep(b, &q->lock);
+  }
+  submit(q, &b, 1, 1, 1, 0);
+  release(&q->lock);
+}
+
+// Make every write the device has finished durable, by
+// flushing its write cache, if it has one.
+void
+disk_flush(uint dev)
+{
+  struct ioqueue *q = getq(dev);
+
+  if(q->bdev->flush)
+    q->bdev->flush(q->bdev);
+}
+
+// Wait until every write queued by disk_write_async() has
+// reached the disk, and flush it there.
+void
+disk_barrier(uint dev)
+{
+  struct ioqueue *q = getq(dev);
+
+  acquire(&q->lock);
+  unplug(q);
+  while(q->nwriting > 0)
+    sleep(&q->nwriting, &q->lock);
+  release(&q->lock);
+  disk_flush(dev);
+}
+
+// Request r is finished: hand its buffers back and free it.
+// Caller must hold q->lock.
+static void
+complete(struct ioqueue *q, struct ioreq *r)
+{
+  struct buf *b, *nb;
+  uint64 t;
+  int i;
+
+  for(b = r->head; b; b = nb){
+    nb = b->qnext;
+    if(!r->write)
+      b->valid = 1;
+    b->disk = 0;
+    wakeup(b);
+    if(r->async){
+      // drop the reference of whoever queued it.
+      bunpin(b);
+      if(r->write && --q->nwriting == 0)
+        wakeup(&q->nwriting);
+    }
+  }
+  t = r_time() - r->arrive;
+  for(i = 0; i < NLATHIST-1 && (2ULL << i) <= t; i++)
+    ;
+  q->lat[i]++;
+  q->inflight--;
+  reqfree(r);
+  wakeup(&iosched.free);
+}
+
+// Called by the driver, from its interrupt handler, when it has
+// finished request r.
+void
+disk_done(struct ioreq *r)
+{
+  struct ioqueue *q = getq(r->dev);
+
+  acquire(&q->lock);
+  complete(q, r);
+  dispatch(q);
+  release(&q->lock);
+}
+
+// Turn polling on (1) or off (0), if on is not -1.
+// Returns the previous setting.
+int
+disk_setpoll(int on)
+{
+  int old = diskpoll;
+
+  if(on < -1 || on > 1)
+    return -1;
+  if(on >= 0)
+    diskpoll = on;
+  return old;
+}
+
+// Format the queues' counters for the statistics device.
+int
+statsdisk(char *buf, int sz)
+{
+  struct ioqueue *q;
+  int i, j, n = 0;
+
+  for(i = 0; i < NDISK; i++){
+    q = &iosched.q[i];
+    if(q->bdev == 0)
+      continue;
+    acquire(&q->lock);
+    n += snprintf(buf+n, sz-n,
+                  "disk %d requests %l blocks %l backmerge %l frontmerge %l late %l"
+                  " queued %d maxqueued %d inflight %d maxinflight %d"
+                  " polls %l pollhits %l pollavg %l driver %s capacity %d\n",
+                  ROOTDEV + i, q->nrequest, q->nblock, q->backmerge, q->frontmerge,
+                  q->nlate, q->nqueued, q->maxqueued, q->inflight, q->maxinflight,
+                  q->npoll, q->npollhit, q->pollavg, q->bdev->name, q->size);
+    n += snprintf(buf+n, sz-n, "disklat %d", ROOTDEV + i);
+    for(j = 0; j < NLATHIST; j++)
+      n += snprintf(buf+n, sz-n, " %l", q->lat[j]);
+    n += snprintf(buf+n, sz-n, "\n");
+    release(&q->lock);
+  }
+  return n;
+}
@@ -0,0 +1,18 @@
+// A disk request: a run of buffers holding consecutive blocks,
+// all read or all written by one device operation.
+struct ioreq {
+  uint dev;
+  uint blockno;         // block of the first buffer
+  int n;                // number of buffers
+  struct buf *head;     // the buffers, in block order, through qnext
+  struct buf *tail;
+  char write;
+  char async;           // no one waits; disk_done() unpins the buffers
+  char held;            // plugged write, not to be sent yet
+  char queued;          // in the queue, not yet sent
+  char flush;           // a cache flush, with no buffers (drivers only)
+  uint64 arrive;        // r_time() when queued
+  uint64 deadline;      // send it by then, whatever the elevator says
+  struct ioreq *next;   // next in the queue, or in the free list
+  void (*done)(struct ioreq*);  // the driver calls it when r is finished
+};
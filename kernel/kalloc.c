@@ -18,16 +18,36 @@ struct run {
   struct run *next;
 };
 
+#define NSHRINKER 4
+
+// Below KLOWPAGES free pages, kalloc() asks the shrinkers for
+// enough to get back to KHIGHPAGES. The shrinkers may lock a
+// whole cache, so it asks at most once every KSHRINKGAP
+// cycles, unless it is out of pages.
+#define KLOWPAGES  64
+#define KHIGHPAGES 128
+#define KSHRINKGAP (TICKINTERVAL/10)
+
 struct {
   struct spinlock lock;
   struct run *freelist;
+  int nfree;          // pages on freelist
+
+  // caches that can give memory back; see kshrinkadd().
+  int (*shrinker[NSHRINKER])(int);
+  int nshrinker;
+  uint64 nextshrink;  // no shrinking below KLOWPAGES before this
 } kmem;
 
 void
 kinit()
 {
-  initlock(&kmem.lock, "kmem");
+  initlocktype(&kmem.lock, "kmem", LOCK_TICKET);
+#ifdef RAMDISKROOT
+  freerange(end, (void*)RAMDISK);
+#else
   freerange(end, (void*)PHYSTOP);
+#endif
 }
 
 void
@@ -59,9 +79,40 @@ kfree(void *pa)
   acquire(&kmem.lock);
   r->next = kmem.freelist;
   kmem.freelist = r;
+  kmem.nfree++;
+  release(&kmem.lock);
+}
+
+// Register a cache that can give pages back when memory runs
+// low. fn(n) should kfree() up to n pages and return how many
+// it freed. It is called from kalloc(), and so may run with
+// any locks held by kalloc()'s callers: it must not sleep,
+// and must not take locks that are held across kalloc().
+void
+kshrinkadd(int (*fn)(int))
+{
+  acquire(&kmem.lock);
+  if(kmem.nshrinker >= NSHRINKER)
+    panic("kshrinkadd");
+  kmem.shrinker[kmem.nshrinker++] = fn;
   release(&kmem.lock);
 }
 
+// Ask the shrinkers for n pages.
+static void
+kshrink(int n)
+{
+  for(int i = 0; i < kmem.nshrinker && n > 0; i++)
+    n -= kmem.shrinker[i](n);
+}
+
+// Number of free pages; a snapshot.
+int
+kfreepages(void)
+{
+  return kmem.nfree;
+}
+
 // Allocate one 4096-byte page of physical memory.
 // Returns a pointer that the kernel can use.
 // Returns 0 if the memory cannot be allocated.
@@ -69,13 +120,35 @@ void *
 kalloc(void)
 {
   struct run *r;
+  int nfree, shrink;
 
   acquire(&kmem.lock);
   r = kmem.freelist;
-  if(r)
+  if(r){
     kmem.freelist = r->next;
+    kmem.nfree--;
+  }
+  nfree = kmem.nfree;
+  shrink = r == 0;
+  if(nfree < KLOWPAGES && r_time() >= kmem.nextshrink){
+    kmem.nextshrink = r_time() + KSHRINKGAP;
+    shrink = 1;
+  }
   release(&kmem.lock);
 
+  if(shrink){
+    kshrink(KHIGHPAGES - nfree);
+    if(r == 0){
+      acquire(&kmem.lock);
+      r = kmem.freelist;
+      if(r){
+        kmem.freelist = r->next;
+        kmem.nfree--;
+      }
+      release(&kmem.lock);
+    }
+  }
+
   if(r)
     memset((char*)r, 5, PGSIZE); // fill with junk
   return (void*)r;
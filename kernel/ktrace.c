@@ -0,0 +1,136 @@
+// Kernel event tracing.
+//
+// Tracepoints call KTRACE() (see defs.h), which costs a load and
+// a branch unless the event's bit is set in ktracemask, in which
+// case ktracerecord() appends a fixed-size record to the hart's
+// ring buffer. As in prof.c, each ring has one writer, its own
+// hart with interrupts off, and is drained by ktrace_read()
+// under ktrace.lock, so recording takes no lock.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "ktrace.h"
+#include "defs.h"
+
+#define NKTRACE 1024     // ring size per hart; a power of two
+
+int ktracemask;          // enabled event types
+
+static struct {
+  struct spinlock lock;  // serializes readers
+  struct {
+    struct ktraceevent e[NKTRACE];
+    uint head;           // next entry the hart writes
+    uint tail;           // next entry ktrace_read() reads
+    uint dropped;        // not yet reported with a KT_LOST record
+  } ring[NCPU];
+} ktrace;
+
+void
+ktraceinit(void)
+{
+  initlock(&ktrace.lock, "ktrace");
+}
+
+void
+ktracerecord(int type, uint64 arg0, uint64 arg1)
+{
+  struct cpu *c;
+  struct ktraceevent *e;
+  int id;
+
+  push_off();
+  c = mycpu();
+  id = cpuid();
+  if(ktrace.ring[id].head - ktrace.ring[id].tail >= NKTRACE){
+    __sync_fetch_and_add(&ktrace.ring[id].dropped, 1);
+    pop_off();
+    return;
+  }
+  e = &ktrace.ring[id].e[ktrace.ring[id].head % NKTRACE];
+  e->time = r_time();
+  e->arg[0] = arg0;
+  e->arg[1] = arg1;
+  e->pid = c->proc ? c->proc->pid : 0;
+  e->hart = id;
+  e->type = type;
+  __sync_synchronize();
+  ktrace.ring[id].head++;
+  pop_off();
+}
+
+// Set the enabled event types. Turning tracing on from off
+// discards whatever is left in the rings.
+uint64
+sys_ktrace(void)
+{
+  int mask;
+
+  if(argint(0, &mask) < 0)
+    return -1;
+
+  acquire(&ktrace.lock);
+  if(ktracemask == 0 && mask != 0){
+    for(int i = 0; i < NCPU; i++){
+      ktrace.ring[i].tail = ktrace.ring[i].head;
+      ktrace.ring[i].dropped = 0;
+    }
+  }
+  ktracemask = mask;
+  release(&ktrace.lock);
+  return 0;
+}
+
+// Copy up to n records, from all harts, to the array of
+// struct ktraceevent at addr. Returns the number copied.
+// Records from one hart are in time order; records from
+// different harts are not merged.
+uint64
+sys_ktrace_read(void)
+{
+  uint64 addr;
+  int n, got = 0;
+  uint dropped;
+  struct ktraceevent e;
+  struct proc *p = myproc();
+
+  if(argaddr(0, &addr) < 0 || argint(1, &n) < 0)
+    return -1;
+
+  acquire(&ktrace.lock);
+  for(int i = 0; i < NCPU && got < n; i++){
+    while(got < n && ktrace.ring[i].tail != ktrace.ring[i].head){
+      __sync_synchronize();
+      e = ktrace.ring[i].e[ktrace.ring[i].tail % NKTRACE];
+      __sync_synchronize();
+      ktrace.ring[i].tail++;
+      if(copyout(p->pagetable, addr + got*sizeof(e), (char*)&e, sizeof(e)) < 0){
+        release(&ktrace.lock);
+        return -1;
+      }
+      got++;
+    }
+    // the ring has room again; say how much was lost.
+    dropped = ktrace.ring[i].dropped;
+    if(dropped && got < n){
+      __sync_fetch_and_sub(&ktrace.ring[i].dropped, dropped);
+      e.time = r_time();
+      e.arg[0] = dropped;
+      e.arg[1] = 0;
+      e.pid = 0;
+      e.hart = i;
+      e.type = KT_LOST;
+      if(copyout(p->pagetable, addr + got*sizeof(e), (char*)&e, sizeof(e)) < 0){
+        release(&ktrace.lock);
+        return -1;
+      }
+      got++;
+    }
+  }
+  release(&ktrace.lock);
+  return got;
+}
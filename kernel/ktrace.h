@@ -0,0 +1,23 @@
+// Kernel event trace records, as returned by ktrace_read().
+// Both the kernel and user programs use this header file.
+
+// event types; ktrace(mask) enables type t if bit (1<<t) is set.
+#define KT_LOST       0  // arg0: records this hart dropped
+#define KT_SWITCHIN   1  // scheduler runs a process. arg0: pid
+#define KT_SWITCHOUT  2  // and gets the hart back. arg0: pid, arg1: its state
+#define KT_SLEEP      3  // arg0: chan, arg1: deadline or 0
+#define KT_WAKEUP     4  // arg0: chan, arg1: pid woken
+#define KT_DISKSUBMIT 5  // arg0: blockno, arg1: 1 if write
+#define KT_DISKDONE   6  // arg0: blockno
+#define KT_COMMIT     7  // log commit starts. arg0: blocks in transaction
+#define KT_COMMITDONE 8  // log commit ends
+#define KT_PAGEFAULT  9  // arg0: stval, arg1: scause
+#define NKTEVENT     10
+
+struct ktraceevent {
+  uint64 time;          // CLINT_MTIME
+  uint64 arg[2];        // meaning depends on type
+  int pid;              // running process, or 0 in the scheduler
+  ushort hart;
+  ushort type;          // KT_*
+};
@@ -6,50 +6,134 @@
 #include "sleeplock.h"
 #include "fs.h"
 #include "buf.h"
+#include "proc.h"
+#include "ktrace.h"
 
 // Simple logging that allows concurrent FS system calls.
 //
 // A log transaction contains the updates of multiple FS system
-// calls. The logging system only commits when there are
-// no FS system calls active. Thus there is never
-// any reasoning required about whether a commit might
-// write an uncommitted system call's updates to disk.
+// calls. A transaction is only committed when it has no FS
+// system calls active. Thus there is never any reasoning
+// required about whether a commit might write an uncommitted
+// system call's updates to disk.
 //
 // A system call should call begin_op()/end_op() to mark
-// its start and end. Usually begin_op() just increments
-// the count of in-progress FS system calls and returns.
-// But if it thinks the log is close to running out, it
-// sleeps until the last outstanding end_op() commits.
+// its start and end. begin_op() reserves room in the open
+// transaction for as many blocks as the call may write
+// (OP_* in fs.h), and end_op() gives back what it did not
+// use. If the transaction has no room left, begin_op() sleeps
+// until it has been committed.
+//
+// There are two transactions in memory: the open one, which
+// begin_op() adds system calls to, and the one being committed.
+// When the last system call of the open transaction ends, that
+// transaction is closed, the other one opens, and the process
+// that ended it commits it, while new system calls carry on in
+// the newly opened transaction. The commit first copies the
+// transaction's blocks into shadow buffers outside the cache,
+// and writes those, not the cached blocks, both to the log and
+// home; the system calls of the next transaction are then free
+// to modify the cached blocks. Only that copy holds up new
+// system calls.
 //
 // The log is a physical re-do log containing disk blocks.
 // The on-disk log format:
-//   header block, containing block #s for block A, B, C, ...
-//   block A
-//   block B
-//   block C
-//   ...
-// Log appends are synchronous.
+//   header block, containing block #s for block A, B, C, ...,
+//     the slot at which A is logged, the transaction's sequence
+//     number, and a checksum of all that and of A, B, C, ...
+//   log slots, used round-robin: block A, block B, block C, ...
+// Each transaction is logged at the slots following the last
+// one's. The log has room for two transactions, so a commit
+// never overwrites the slots of the transaction that the header
+// on disk still describes, and there is no need to clear the
+// header once a transaction is installed: recovery installs the
+// transaction it describes again, which is harmless. mkfs sets
+// the size of the log, and so of a transaction: half the
+// slots, up to LOGMAX blocks.
+//
+// A commit writes the header and the log blocks together,
+// without waiting for each, in no particular order; then waits
+// for all of them and flushes the disk's write cache (bflush).
+// The transaction is committed once all of them are durable,
+// which recovery tells by the checksum: if a crash leaves any of
+// them unwritten, the checksum does not match, and recovery
+// drops the transaction. The commit then installs the blocks
+// the same way, with one more bflush.
 
 // Contents of the header block, used for both the on-disk header block
 // and to keep track in memory of logged block# before commit.
 struct logheader {
   int n;
-  int block[LOGSIZE];
+  int slot;  // log slot of block[0]; the rest follow, round-robin
+  uint seq;  // of this transaction, from 1; 0 if none was committed
+  uint crc;  // of the header, with crc 0, and the logged blocks
+  int block[LOGMAX];
 };
 
 struct log {
   struct spinlock lock;
   int start;
-  int size;
+  int size;        // log slots, after the header block
+  int max;         // most blocks in a transaction
   int outstanding; // how many FS sys calls are executing.
-  int committing;  // in commit(), please wait.
+  int reserved;    // blocks they may yet add to the open transaction
+  int committing;  // a process is in commit().
+  int copying;     // commit() is copying the closed transaction.
   int dev;
-  struct logheader lh;
+  struct logheader trans[2]; // the open and the committing transaction
+  int cur;         // which of trans[] is open
+  int head;        // slot after the last block logged
+  uint seq;        // of the next transaction, never 0
+
+  // the committing transaction's blocks: their cache buffers,
+  // which log_write() pinned, and copies of their contents.
+  struct buf *cached[LOGMAX];
+  struct buf shadow[LOGMAX];
 };
 struct log log;
 
 static void recover_from_log(void);
-static void commit();
+static void commit(struct logheader *lh);
+
+static uint crctab[256];
+
+static void
+crcinit(void)
+{
+  uint c;
+
+  for (int i = 0; i < 256; i++) {
+    c = i;
+    for (int k = 0; k < 8; k++)
+      c = (c & 1) ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+    crctab[i] = c;
+  }
+}
+
+// CRC-32 of the n bytes at p, continuing from crc.
+static uint
+crc32(uint crc, void *p, int n)
+{
+  uchar *s = p;
+
+  crc = ~crc;
+  while (n-- > 0)
+    crc = crctab[(crc ^ *s++) & 0xff] ^ (crc >> 8);
+  return ~crc;
+}
+
+// Checksum of the header lh, with crc 0.
+static uint
+headcrc(struct logheader *lh)
+{
+  uint crc = lh->crc;
+  uint sum;
+
+  lh->crc = 0;
+  sum = crc32(0, lh, sizeof(*lh) - (LOGMAX - lh->n) * sizeof(int));
+  lh->crc = crc;
+  return sum;
+}
 
 void
 initlog(int dev, struct superblock *sb)
@@ -57,154 +141,273 @@ initlog(int dev, struct superblock *sb)
   if (sizeof(struct logheader) >= BSIZE)
     panic("initlog: too big logheader");
 
-  initlock(&log.lock, "log");
+  initlocktype(&log.lock, "log", LOCK_MCS);
   log.start = sb->logstart;
-  log.size = sb->nlog;
+  log.size = sb->nlog - 1;
+  log.max = log.size / 2;
+  if (log.max > LOGMAX)
+    log.max = LOGMAX;
   log.dev = dev;
+  if (log.max < MAXOPBLOCKS)
+    panic("initlog: log too small");
+  breserve(2*log.max);  // log_write() pins up to this many
+  crcinit();
+  for (int i = 0; i < log.max; i++) {
+    initsleeplock(&log.shadow[i].lock, "shadow");
+    log.shadow[i].dev = dev;
+  }
   recover_from_log();
 }
 
-// Copy committed blocks from log to their home location
+// disk block of log slot s.
+static int
+slotblock(int s)
+{
+  return log.start + 1 + s % log.size;
+}
+
+// Did all of lh's blocks reach the log? During recovery.
+static int
+logvalid(struct logheader *lh)
+{
+  uint crc;
+  int tail;
+
+  if (lh->seq == 0)  // the empty log that mkfs writes
+    return 0;
+  if (lh->n < 0 || lh->n > log.max || lh->slot < 0 || lh->slot >= log.size)
+    return 0;
+  crc = headcrc(lh);
+  for (tail = 0; tail < lh->n; tail++) {
+    struct buf *lbuf = bread(log.dev, slotblock(lh->slot+tail));
+    crc = crc32(crc, lbuf->data, BSIZE);
+    brelse(lbuf);
+  }
+  return crc == lh->crc;
+}
+
+// Copy the committed blocks of lh from log to their home
+// location, during recovery.
 static void
-install_trans(int recovering)
+install_log(struct logheader *lh)
 {
   int tail;
 
-  for (tail = 0; tail < log.lh.n; tail++) {
-    struct buf *lbuf = bread(log.dev, log.start+tail+1); // read log block
-    struct buf *dbuf = bread(log.dev, log.lh.block[tail]); // read dst
+  for (tail = 0; tail < lh->n; tail++) {
+    struct buf *lbuf = bread(log.dev, slotblock(lh->slot+tail)); // read log block
+    struct buf *dbuf = bread(log.dev, lh->block[tail]); // read dst
     memmove(dbuf->data, lbuf->data, BSIZE);  // copy block to dst
-    bwrite(dbuf);  // write dst to disk
-    if(recovering == 0)
-      bunpin(dbuf);
+    bawrite(dbuf);  // start writing dst to disk
     brelse(lbuf);
     brelse(dbuf);
   }
+  bflush(log.dev);  // wait for all of them, and make them durable
 }
 
-// Read the log header from disk into the in-memory log header
+// Read the log header from disk into lh.
 static void
-read_head(void)
+read_head(struct logheader *lh)
 {
   struct buf *buf = bread(log.dev, log.start);
-  struct logheader *lh = (struct logheader *) (buf->data);
+  struct logheader *hb = (struct logheader *) (buf->data);
   int i;
-  log.lh.n = lh->n;
-  for (i = 0; i < log.lh.n; i++) {
-    log.lh.block[i] = lh->block[i];
+  lh->n = hb->n;
+  lh->slot = hb->slot;
+  lh->seq = hb->seq;
+  lh->crc = hb->crc;
+  for (i = 0; i < lh->n && i < LOGMAX; i++) {
+    lh->block[i] = hb->block[i];
   }
   brelse(buf);
 }
 
-// Write in-memory log header to disk.
-// This is the true point at which the
-// current transaction commits.
+// Start writing the header of transaction lh to disk. The
+// transaction commits when it and the log blocks are durable.
 static void
-write_head(void)
+write_head(struct logheader *lh)
 {
   struct buf *buf = bread(log.dev, log.start);
   struct logheader *hb = (struct logheader *) (buf->data);
   int i;
-  hb->n = log.lh.n;
-  for (i = 0; i < log.lh.n; i++) {
-    hb->block[i] = log.lh.block[i];
+  hb->n = lh->n;
+  hb->slot = lh->slot;
+  hb->seq = lh->seq;
+  hb->crc = lh->crc;
+  for (i = 0; i < lh->n; i++) {
+    hb->block[i] = lh->block[i];
   }
-  bwrite(buf);
+  bawrite(buf);
   brelse(buf);
 }
 
 static void
 recover_from_log(void)
 {
-  read_head();
-  install_trans(1); // if committed, copy from log to disk
-  log.lh.n = 0;
-  write_head(); // clear the log
+  struct logheader lh;
+
+  read_head(&lh);
+  log.head = 0;
+  log.seq = 1;
+  // the header describes no complete transaction if mkfs
+  // made the log, or if a commit did not finish (which it
+  // starts only once the transaction before is installed).
+  // then its seq may be garbage too, and numbering restarts.
+  if (logvalid(&lh)) {
+    install_log(&lh); // committed; copy from log to disk
+    log.head = (lh.slot + lh.n) % log.size;
+    log.seq = lh.seq + 1;
+  }
 }
 
-// called at the start of each FS system call.
+// called at the start of each FS system call, which will add
+// at most n blocks to the transaction.
 void
-begin_op(void)
+begin_op(int n)
 {
+  if(n > log.max)
+    panic("begin_op: too big an op");
   acquire(&log.lock);
   while(1){
-    if(log.committing){
+    if(log.copying){
       sleep(&log, &log.lock);
-    } else if(log.lh.n + (log.outstanding+1)*MAXOPBLOCKS > LOGSIZE){
-      // this op might exhaust log space; wait for commit.
+    } else if(log.trans[log.cur].n + log.reserved + n > log.max){
+      // this op might exhaust the transaction; wait for commit.
       sleep(&log, &log.lock);
     } else {
       log.outstanding += 1;
+      log.reserved += n;
+      myproc()->logres = n;
       release(&log.lock);
       break;
     }
   }
 }
 
+// Close the open transaction, which has no outstanding ops;
+// later ops join the other one, once commit() has copied the
+// closed one's blocks. Returns the closed transaction.
+// Caller holds log.lock.
+static struct logheader *
+close_trans(void)
+{
+  struct logheader *lh = &log.trans[log.cur];
+
+  log.cur ^= 1;
+  log.copying = 1;
+  return lh;
+}
+
 // called at the end of each FS system call.
-// commits if this was the last outstanding operation.
+// commits the open transaction if this was its last
+// outstanding operation, unless another commit is under way,
+// in which case that one goes on to commit it.
 void
 end_op(void)
 {
-  int do_commit = 0;
+  struct logheader *lh = 0;
 
   acquire(&log.lock);
   log.outstanding -= 1;
-  if(log.committing)
-    panic("log.committing");
-  if(log.outstanding == 0){
-    do_commit = 1;
+  log.reserved -= myproc()->logres;
+  myproc()->logres = 0;
+  if(log.outstanding == 0 && !log.committing && log.trans[log.cur].n > 0){
+    // close it before releasing the lock, so that no op
+    // can join it once it has none outstanding.
+    lh = close_trans();
     log.committing = 1;
   } else {
     // begin_op() may be waiting for log space,
-    // and decrementing log.outstanding has decreased
-    // the amount of reserved space.
+    // and this op has given back what it did not use.
     wakeup(&log);
   }
   release(&log.lock);
 
-  if(do_commit){
+  while(lh){
     // call commit w/o holding locks, since not allowed
     // to sleep with locks.
-    commit();
+    commit(lh);
     acquire(&log.lock);
-    log.committing = 0;
+    // the next transaction may have finished its ops meanwhile.
+    if(log.outstanding == 0 && log.trans[log.cur].n > 0){
+      lh = close_trans();
+    } else {
+      lh = 0;
+      log.committing = 0;
+    }
     wakeup(&log);
     release(&log.lock);
   }
 }
 
-// Copy modified blocks from cache to log.
+// Copy the modified blocks of lh from the cache to the
+// shadow buffers.
 static void
-write_log(void)
+copy_trans(struct logheader *lh)
 {
   int tail;
 
-  for (tail = 0; tail < log.lh.n; tail++) {
-    struct buf *to = bread(log.dev, log.start+tail+1); // log block
-    struct buf *from = bread(log.dev, log.lh.block[tail]); // cache block
-    memmove(to->data, from->data, BSIZE);
-    bwrite(to);  // write the log
+  for (tail = 0; tail < lh->n; tail++) {
+    struct buf *from = bread(log.dev, lh->block[tail]); // cache block
+    memmove(log.shadow[tail].data, from->data, BSIZE);
+    log.cached[tail] = from;
     brelse(from);
-    brelse(to);
   }
 }
 
+// Start writing the shadow buffers of lh to the log, or home.
 static void
-commit()
-{
-  if (log.lh.n > 0) {
-    write_log();     // Write modified blocks from cache to log
-    write_head();    // Write header to disk -- the real commit
-    install_trans(0); // Now install writes to home locations
-    log.lh.n = 0;
-    write_head();    // Erase the transaction from the log
+write_shadows(struct logheader *lh, int home)
+{
+  int tail;
+
+  for (tail = 0; tail < lh->n; tail++) {
+    struct buf *s = &log.shadow[tail];
+    acquiresleep(&s->lock);
+    s->blockno = home ? lh->block[tail] : slotblock(lh->slot+tail);
+    bawrite(s);
+    releasesleep(&s->lock);
   }
 }
 
+// Commit lh, which end_op() has closed.
+static void
+commit(struct logheader *lh)
+{
+  int tail;
+
+  KTRACE(KT_COMMIT, lh->n, 0);
+  lh->slot = log.head;
+  lh->seq = log.seq++;
+  if (log.seq == 0)
+    log.seq = 1;
+  copy_trans(lh);
+
+  acquire(&log.lock);
+  log.copying = 0;
+  wakeup(&log);
+  release(&log.lock);
+
+  lh->crc = headcrc(lh);
+  for (tail = 0; tail < lh->n; tail++)
+    lh->crc = crc32(lh->crc, log.shadow[tail].data, BSIZE);
+  write_shadows(lh, 0); // Write modified blocks to log
+  write_head(lh);       // and the header that commits them
+  bflush(log.dev);      // the real commit: all of them durable
+  write_shadows(lh, 1); // Now install writes to home locations
+  bflush(log.dev);
+  for (tail = 0; tail < lh->n; tail++)
+    bunpin(log.cached[tail]);  // log_write() pinned it
+  log.head = (lh->slot + lh->n) % log.size;
+  lh->n = 0;
+  KTRACE(KT_COMMITDONE, 0, 0);
+}
+
 // Caller has modified b->data and is done with the buffer.
-// Record the block number and pin in the cache by increasing refcnt.
-// commit()/write_log() will do the disk write.
+// Record the block number in the open transaction and pin in
+// the cache by increasing refcnt. commit() will do the disk write.
+// A new block uses up one of the blocks that the caller
+// reserved; beyond those, it takes room that others reserved,
+// and may overflow the transaction.
 //
 // log_write() replaces bwrite(); a typical use is:
 //   bp = bread(...)
@@ -214,23 +417,28 @@ commit()
 void
 log_write(struct buf *b)
 {
+  struct logheader *lh;
   int i;
 
   acquire(&log.lock);
-  if (log.lh.n >= LOGSIZE || log.lh.n >= log.size - 1)
+  lh = &log.trans[log.cur];
+  if (lh->n >= log.max)
     panic("too big a transaction");
   if (log.outstanding < 1)
     panic("log_write outside of trans");
 
-  for (i = 0; i < log.lh.n; i++) {
-    if (log.lh.block[i] == b->blockno)   // log absorption
+  for (i = 0; i < lh->n; i++) {
+    if (lh->block[i] == b->blockno)   // log absorption
       break;
   }
-  log.lh.block[i] = b->blockno;
-  if (i == log.lh.n) {  // Add new block to log?
+  lh->block[i] = b->blockno;
+  if (i == lh->n) {  // Add new block to log?
     bpin(b);
-    log.lh.n++;
+    lh->n++;
+    if (myproc()->logres > 0) {
+      myproc()->logres--;
+      log.reserved--;
+    }
   }
   release(&log.lock);
 }
-
@@ -20,14 +20,22 @@ main()
     kvminit();       // create kernel page table
     kvminithart();   // turn on paging
     procinit();      // process table
-    trapinit();      // trap vectors
+    profinit();      // sampling profiler
+    ktraceinit();    // event tracing
     trapinithart();  // install kernel trap vector
+    timerinithart(); // per-hart timers
     plicinit();      // set up interrupt controller
     plicinithart();  // ask PLIC for device interrupts
     binit();         // buffer cache
+    ioschedinit();   // disk request queues
     iinit();         // inode table
     fileinit();      // file table
+    statsinit();     // statistics device
+#ifdef RAMDISKROOT
+    ramdiskinit();   // root disk image in memory
+#else
     virtio_disk_init(); // emulated hard disk
+#endif
     userinit();      // first user process
     __sync_synchronize();
     started = 1;
@@ -38,6 +46,7 @@ main()
     printf("hart %d starting\n", cpuid());
     kvminithart();    // turn on paging
     trapinithart();   // install kernel trap vector
+    timerinithart();  // per-hart timers
     plicinithart();   // ask PLIC for device interrupts
   }
 
@@ -5,9 +5,18 @@
 #define NINODE       50  // maximum number of active i-nodes
 #define NDEV         10  // maximum major device number
 #define ROOTDEV       1  // device number of file system root disk
+#define NDISK         1  // disks, numbered from ROOTDEV
+#define NVIRTIO       2  // virtio disks looked for (VIRTIO0, VIRTIO1)
+#define STRIPESZ      8  // blocks per disk in each stripe of a striped root (mkfs -s agrees)
 #define MAXARG       32  // max exec arguments
 #define MAXOPBLOCKS  10  // max # of blocks any FS op writes
-#define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in on-disk log
-#define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
-#define FSSIZE       1000  // size of file system in blocks
+#define LOGSIZE      (MAXOPBLOCKS*3)  // data blocks in one log transaction, unless mkfs -l
+#define LOGMAX       128  // most data blocks in one log transaction
+#define NBUF         (MAXOPBLOCKS*3)  // minimum size of disk block cache, besides pinned blocks
+#define BCACHEPCT    50  // % of free memory the block cache may grow into
+#define MAXSEG       32  // most blocks in one disk request
+#define FSSIZE       2000  // size of file system in blocks
 #define MAXPATH      128   // maximum file path name
+#define TICKINTERVAL 1000000  // CLINT_MTIME cycles between scheduler ticks
+#define NLOCK       500  // maximum number of locks tracked by lockstat
+#define NTIMER       (NPROC+NCPU)  // maximum pending timers per hart
@@ -4,6 +4,9 @@
 #include "riscv.h"
 #include "spinlock.h"
 #include "proc.h"
+#include "fs.h"
+#include "timer.h"
+#include "ktrace.h"
 #include "defs.h"
 
 struct cpu cpus[NCPU];
@@ -163,6 +166,7 @@ freeproc(struct proc *p)
   p->chan = 0;
   p->killed = 0;
   p->xstate = 0;
+  p->tracemask = 0;
   p->state = UNUSED;
 }
 
@@ -303,6 +307,8 @@ fork(void)
 
   safestrcpy(np->name, p->name, sizeof(p->name));
 
+  np->tracemask = p->tracemask;
+
   pid = np->pid;
 
   release(&np->lock);
@@ -314,6 +320,7 @@ fork(void)
   acquire(&np->lock);
   np->state = RUNNABLE;
   release(&np->lock);
+  timerkick();
 
   return pid;
 }
@@ -353,7 +360,7 @@ exit(int status)
     }
   }
 
-  begin_op();
+  begin_op(OP_IPUT);
   iput(p->cwd);
   end_op();
   p->cwd = 0;
@@ -439,12 +446,15 @@ scheduler(void)
 {
   struct proc *p;
   struct cpu *c = mycpu();
+  int found;
   
   c->proc = 0;
   for(;;){
     // Avoid deadlock by ensuring that devices can interrupt.
     intr_on();
 
+    found = 0;
+
     for(p = proc; p < &proc[NPROC]; p++) {
       acquire(&p->lock);
       if(p->state == RUNNABLE) {
@@ -453,14 +463,30 @@ scheduler(void)
         // before jumping back to us.
         p->state = RUNNING;
         c->proc = p;
+        timerresume();
+        KTRACE(KT_SWITCHIN, p->pid, 0);
         swtch(&c->context, &p->context);
 
         // Process is done running for now.
         // It should have changed its p->state before coming back.
+        KTRACE(KT_SWITCHOUT, p->pid, p->state);
         c->proc = 0;
+        found = 1;
       }
       release(&p->lock);
     }
+
+    if(found == 0){
+      // Nothing to run. Stop the scheduler tick and wait
+      // for an interrupt. timeridle() publishes c->nohz
+      // before the re-check, so a process made runnable
+      // after it is seen either here or by timerkick(),
+      // whose timer interrupt ends the wfi.
+      intr_off();
+      timeridle();
+      if(anyrunnable() == 0)
+        asm volatile("wfi");
+    }
   }
 }
 
@@ -487,6 +513,7 @@ sched(void)
     panic("sched interruptible");
 
   intena = mycpu()->intena;
+  rcu_qs();
   swtch(&p->context, &mycpu()->context);
   mycpu()->intena = intena;
 }
@@ -543,6 +570,7 @@ sleep(void *chan, struct spinlock *lk)
   // Go to sleep.
   p->chan = chan;
   p->state = SLEEPING;
+  KTRACE(KT_SLEEP, (uint64)chan, 0);
 
   sched();
 
@@ -554,22 +582,113 @@ sleep(void *chan, struct spinlock *lk)
   acquire(lk);
 }
 
+// Timer callback for sleepuntil(): wake p if it is asleep.
+// A timer that fires just as p wakes for another reason may
+// wake p from a later sleep(); callers of sleep() re-check
+// their condition, so that is harmless.
+static void
+sleeptimeout(void *arg)
+{
+  struct proc *p = arg;
+
+  acquire(&p->lock);
+  if(p->state == SLEEPING){
+    p->state = RUNNABLE;
+    KTRACE(KT_WAKEUP, (uint64)p->chan, p->pid);
+  }
+  release(&p->lock);
+  timerkick();
+}
+
+// Like sleep(), but also wake up once CLINT_MTIME
+// reaches deadline, without disturbing other sleepers.
+// lk may be p->lock, for a caller that waits for
+// nothing but the deadline.
+// Returns 1 if the deadline has passed.
+int
+sleepuntil(void *chan, struct spinlock *lk, uint64 deadline)
+{
+  struct proc *p = myproc();
+  struct timer t;
+
+  if(lk != &p->lock){
+    acquire(&p->lock);
+    release(lk);
+  }
+
+  // arm the timer while holding p->lock, so that
+  // sleeptimeout() cannot run before p is asleep.
+  timerset(&t, deadline, sleeptimeout, p);
+
+  p->chan = chan;
+  p->state = SLEEPING;
+  KTRACE(KT_SLEEP, (uint64)chan, deadline);
+
+  sched();
+
+  p->chan = 0;
+  timercancel(&t);
+
+  if(lk != &p->lock){
+    release(&p->lock);
+    acquire(lk);
+  }
+  return r_time() >= deadline;
+}
+
 // Wake up all processes sleeping on chan.
 // Must be called without any p->lock.
 void
 wakeup(void *chan)
 {
   struct proc *p;
+  int woke = 0;
 
   for(p = proc; p < &proc[NPROC]; p++) {
     if(p != myproc()){
       acquire(&p->lock);
       if(p->state == SLEEPING && p->chan == chan) {
         p->state = RUNNABLE;
+        woke = 1;
+        KTRACE(KT_WAKEUP, (uint64)chan, p->pid);
       }
       release(&p->lock);
     }
   }
+  if(woke)
+    timerkick();
+}
+
+// Is any process waiting for a CPU? Looks at p->state
+// without p->lock, so the answer can be stale; the
+// tickless timer code copes with that via timerkick().
+int
+anyrunnable(void)
+{
+  struct proc *p;
+
+  for(p = proc; p < &proc[NPROC]; p++) {
+    if(p->state == RUNNABLE)
+      return 1;
+  }
+  return 0;
+}
+
+// Find the process with the given pid without taking every
+// p->lock on the way. proc[] entries are reused but never
+// freed, and pids are not reused, so a caller only needs to
+// re-check p->pid once it holds p->lock. Returns 0 if there
+// is no such process.
+struct proc*
+findproc(int pid)
+{
+  struct proc *p;
+
+  for(p = proc; p < &proc[NPROC]; p++){
+    if(p->pid == pid)
+      break;
+  }
+  return p < &proc[NPROC] ? p : 0;
 }
 
 // Kill the process with the given pid.
@@ -580,20 +699,29 @@ kill(int pid)
 {
   struct proc *p;
 
-  for(p = proc; p < &proc[NPROC]; p++){
-    acquire(&p->lock);
-    if(p->pid == pid){
-      p->killed = 1;
-      if(p->state == SLEEPING){
-        // Wake process from sleep().
-        p->state = RUNNABLE;
-      }
-      release(&p->lock);
-      return 0;
-    }
+  // look the pid up as an RCU reader, and take no
+  // lock but that of the process it finds.
+  rcu_read_lock();
+  if((p = findproc(pid)) == 0){
+    rcu_read_unlock();
+    return -1;
+  }
+  acquire(&p->lock);
+  rcu_read_unlock();
+  if(p->pid != pid){
     release(&p->lock);
+    return -1;
   }
-  return -1;
+  p->killed = 1;
+  if(p->state == SLEEPING){
+    // Wake process from sleep().
+    p->state = RUNNABLE;
+  }
+  release(&p->lock);
+  // a process running on a tickless hart
+  // needs a trap to notice p->killed.
+  timerkick();
+  return 0;
 }
 
 // Copy to either a user address, or kernel address,
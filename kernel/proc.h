@@ -24,6 +24,8 @@ struct cpu {
   struct context context;     // swtch() here to enter scheduler().
   int noff;                   // Depth of push_off() nesting.
   int intena;                 // Were interrupts enabled before push_off()?
+  int nohz;                   // Scheduler tick stopped? See timer.c.
+  int profpending;            // Profiling sample due? See prof.c.
 };
 
 extern struct cpu cpus[NCPU];
@@ -105,4 +107,6 @@ struct proc {
   struct file *ofile[NOFILE];  // Open files
   struct inode *cwd;           // Current directory
   char name[16];               // Process name (debugging)
+  int tracemask;               // System calls to trace; see sys_trace()
+  int logres;                  // Log blocks reserved by begin_op(), not yet written
 };
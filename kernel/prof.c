@@ -0,0 +1,165 @@
+// Sampling profiler.
+//
+// While profiling is on, each hart takes a timer interrupt every
+// profperiod cycles (see timer.c) and kerneltrap()/usertrap() call
+// profintr() with the interrupted pc and frame pointer. profintr()
+// records a frame-pointer backtrace into the hart's ring buffer.
+//
+// Each ring has one writer, its own hart with interrupts off,
+// and is drained by prof_read() under prof.lock, so the writer
+// takes no lock: it fills an entry, then publishes it by
+// advancing head. Samples that find the ring full are dropped.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "prof.h"
+#include "defs.h"
+
+#define NPROFSAMPLE 512  // ring size per hart; a power of two
+
+uint64 profperiod;       // cycles between samples, or 0 if off
+
+extern char stack0[];    // entry.S's per-hart boot and scheduler stacks
+
+static struct {
+  struct spinlock lock;  // serializes readers
+  struct {
+    struct profsample s[NPROFSAMPLE];
+    uint head;           // next entry the hart writes
+    uint tail;           // next entry prof_read() reads
+    uint dropped;
+  } ring[NCPU];
+} prof;
+
+void
+profinit(void)
+{
+  initlock(&prof.lock, "prof");
+}
+
+// Record a sample of the code interrupted on this hart.
+// pc and fp are its program counter and frame pointer (s0);
+// user says whether they belong to the current process's
+// user address space. Called with interrupts off.
+void
+profintr(uint64 pc, uint64 fp, int user)
+{
+  struct cpu *c = mycpu();
+  struct proc *p = c->proc;
+  int id = cpuid();
+  uint64 lo, hi;
+  uint64 frame[2];
+  struct profsample *s;
+
+  c->profpending = 0;
+  if(prof.ring[id].head - prof.ring[id].tail >= NPROFSAMPLE){
+    prof.ring[id].dropped++;
+    return;
+  }
+  s = &prof.ring[id].s[prof.ring[id].head % NPROFSAMPLE];
+
+  s->hart = id;
+  s->pid = p ? p->pid : 0;
+  if(p)
+    safestrcpy(s->name, p->name, sizeof(s->name));
+  else
+    s->name[0] = 0;
+  s->user = user;
+  s->pc[0] = pc;
+  s->depth = 1;
+
+  // follow the saved frame pointers, which lie just below
+  // each frame: fp-8 holds the return address, fp-16 the
+  // caller's fp. stay within the stack we started on: the
+  // user stack page, the process's kernel stack, or the
+  // hart's scheduler stack.
+  if(user){
+    lo = PGROUNDDOWN(fp);
+    hi = lo + PGSIZE;
+  } else if(p && fp > p->kstack && fp <= p->kstack + PGSIZE){
+    lo = p->kstack;
+    hi = lo + PGSIZE;
+  } else {
+    lo = (uint64)stack0 + id*4096;
+    hi = lo + 4096;
+  }
+  while(s->depth < PROFDEPTH && fp - 16 >= lo && fp <= hi){
+    if(user){
+      if(p == 0 || copyin(p->pagetable, (char*)frame, fp - 16, sizeof(frame)) < 0)
+        break;
+    } else {
+      frame[0] = *(uint64*)(fp - 16);
+      frame[1] = *(uint64*)(fp - 8);
+    }
+    s->pc[s->depth++] = frame[1];
+    fp = frame[0];
+  }
+
+  __sync_synchronize();
+  prof.ring[id].head++;
+}
+
+uint64
+sys_prof_start(void)
+{
+  int us;
+
+  if(argint(0, &us) < 0)
+    return -1;
+  if(us <= 0)
+    us = 1000;
+
+  acquire(&prof.lock);
+  for(int i = 0; i < NCPU; i++){
+    prof.ring[i].tail = prof.ring[i].head;
+    prof.ring[i].dropped = 0;
+  }
+  release(&prof.lock);
+
+  profperiod = (uint64)us * 1000 / NSPERCYCLE;
+  // make tickless harts pick up the new period now.
+  timerkick();
+  return 0;
+}
+
+uint64
+sys_prof_stop(void)
+{
+  profperiod = 0;
+  return 0;
+}
+
+// Copy up to n samples, from all harts, to the array of
+// struct profsample at addr. Returns the number copied.
+uint64
+sys_prof_read(void)
+{
+  uint64 addr;
+  int n, got = 0;
+  struct profsample s;
+  struct proc *p = myproc();
+
+  if(argaddr(0, &addr) < 0 || argint(1, &n) < 0)
+    return -1;
+
+  acquire(&prof.lock);
+  for(int i = 0; i < NCPU && got < n; i++){
+    while(got < n && prof.ring[i].tail != prof.ring[i].head){
+      __sync_synchronize();
+      s = prof.ring[i].s[prof.ring[i].tail % NPROFSAMPLE];
+      __sync_synchronize();
+      prof.ring[i].tail++;
+      if(copyout(p->pagetable, addr + got*sizeof(s), (char*)&s, sizeof(s)) < 0){
+        release(&prof.lock);
+        return -1;
+      }
+      got++;
+    }
+  }
+  release(&prof.lock);
+  return got;
+}
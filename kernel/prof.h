@@ -0,0 +1,13 @@
+// Sampling profiler records, as returned by prof_read().
+// Both the kernel and user programs use this header file.
+
+#define PROFDEPTH 8  // pcs recorded per sample
+
+struct profsample {
+  uint64 pc[PROFDEPTH]; // pc[0]: where the hart was; then return addresses
+  int depth;            // number of valid pc[] entries
+  int hart;
+  int pid;              // 0 if no process was running
+  int user;             // are pc[] user addresses?
+  char name[16];        // process name, to find its user/name.sym
+};
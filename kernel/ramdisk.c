@@ -1,5 +1,12 @@
 //
-// ramdisk that uses the disk image loaded by qemu -initrd fs.img
+// ramdisk that uses the disk image loaded by qemu at RAMDISK:
+//
+// qemu ... -device loader,file=fs.img,addr=0x87000000,force-raw=on
+//
+// built with -DRAMDISKROOT (make RAMDISK=1), the kernel mounts
+// it as the root disk instead of the virtio disk. a transfer is
+// a memmove(), finished before submit returns, so the file
+// system runs without the cost of the emulated device.
 //
 
 #include "types.h"
@@ -11,35 +18,48 @@
 #include "sleeplock.h"
 #include "fs.h"
 #include "buf.h"
+#include "iosched.h"
+#include "bdev.h"
 
-void
-ramdiskinit(void)
+static uint ramdisksize;  // in blocks
+
+static int
+ramdisksubmit(struct bdev *bd, struct ioreq *r)
+{
+  char *addr = (char *)RAMDISK + (uint64)r->blockno * BSIZE;
+  struct buf *b;
+
+  for(b = r->head; b; b = b->qnext, addr += BSIZE){
+    if(r->write)
+      memmove(addr, b->data, BSIZE);
+    else
+      memmove(b->data, addr, BSIZE);
+  }
+  return 1;
+}
+
+static uint
+ramdiskcapacity(struct bdev *bd)
 {
+  return ramdisksize;
 }
 
-// If B_DIRTY is set, write buf to disk, clear B_DIRTY, set B_VALID.
-// Else if B_VALID is not set, read buf from disk, set B_VALID.
+static struct bdev ramdisk_bdev = {
+  .name = "ramdisk",
+  .submit = ramdisksubmit,
+  .capacity = ramdiskcapacity,
+};
+
 void
-ramdiskrw(struct buf *b)
+ramdiskinit(void)
 {
-  if(!holdingsleep(&b->lock))
-    panic("ramdiskrw: buf not locked");
-  if((b->flags & (B_VALID|B_DIRTY)) == B_VALID)
-    panic("ramdiskrw: nothing to do");
-
-  if(b->blockno >= FSSIZE)
-    panic("ramdiskrw: blockno too big");
-
-  uint64 diskaddr = b->blockno * BSIZE;
-  char *addr = (char *)RAMDISK + diskaddr;
-
-  if(b->flags & B_DIRTY){
-    // write
-    memmove(addr, b->data, BSIZE);
-    b->flags &= ~B_DIRTY;
-  } else {
-    // read
-    memmove(b->data, addr, BSIZE);
-    b->flags |= B_VALID;
-  }
+  struct superblock *sb = (struct superblock *)(RAMDISK + BSIZE);
+
+  // the image tells us how big it is.
+  if(sb->magic != FSMAGIC)
+    panic("ramdisk: no file system image");
+  if((uint64)sb->size * BSIZE > RAMDISKSZ)
+    panic("ramdisk: image too big");
+  ramdisksize = sb->size;
+  bdevregister(ROOTDEV, &ramdisk_bdev);
 }
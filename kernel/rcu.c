@@ -0,0 +1,79 @@
+// Read-copy-update, with quiescent-state-based grace periods.
+//
+// Readers bracket their accesses with rcu_read_lock() and
+// rcu_read_unlock(), which only turn interrupts off, and must
+// not sleep in between (sched() panics if they try). An
+// updater unlinks an object so that no new reader can find it,
+// then calls synchronize_rcu() before freeing it: that waits
+// until every hart has passed a quiescent state, a point at
+// which it cannot be inside a read-side section.
+//
+// A hart is quiescent when it switches processes (sched()),
+// enters the kernel from user space (usertrap()), takes an
+// interrupt in the kernel (kerneltrap(); interrupts are off
+// in read-side sections), or runs the scheduler with no
+// process. Each passage bumps the hart's counter in rcu.qs.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "defs.h"
+
+static struct {
+  uint64 qs[NCPU];       // quiescent states seen by each hart
+} rcu;
+
+void
+rcu_read_lock(void)
+{
+  push_off();
+}
+
+void
+rcu_read_unlock(void)
+{
+  pop_off();
+}
+
+// Record a quiescent state on this hart.
+// Called with interrupts off.
+void
+rcu_qs(void)
+{
+  rcu.qs[cpuid()]++;
+}
+
+// Wait until every read-side section that was running when
+// synchronize_rcu() was called has finished.
+// Must be called from a process, without spinlocks held.
+void
+synchronize_rcu(void)
+{
+  uint64 snap[NCPU];
+  int waiting;
+
+  __sync_synchronize();
+  for(int i = 0; i < NCPU; i++)
+    snap[i] = rcu.qs[i];
+
+  for(;;){
+    waiting = 0;
+    push_off();
+    for(int i = 0; i < NCPU; i++){
+      // our own hart is running us, and so is quiescent.
+      if(i == cpuid() || rcu.qs[i] != snap[i] || cpus[i].proc == 0)
+        continue;
+      // a tickless hart might not trap for a long time.
+      waiting = 1;
+      timerpoke(i);
+    }
+    pop_off();
+    if(!waiting)
+      break;
+    yield();
+  }
+  __sync_synchronize();
+}
@@ -0,0 +1,97 @@
+// Reader-writer spin locks, for read-mostly data.
+//
+// Like spinlocks, they turn interrupts off while held, and
+// neither readers nor writers may sleep. A waiting writer
+// keeps new readers out, so that a stream of readers cannot
+// starve it.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "spinlock.h"
+#include "rwlock.h"
+#include "riscv.h"
+#include "proc.h"
+#include "defs.h"
+
+void
+initrwlock(struct rwspinlock *lk, char *name)
+{
+  lk->n = 0;
+  lk->writers = 0;
+  lk->name = name;
+  lockstatadd(name, "rw", &lk->stat);
+}
+
+void
+acquireread(struct rwspinlock *lk)
+{
+  uint64 spins = 0;
+  int n;
+
+  push_off(); // disable interrupts to avoid deadlock.
+  for(;;){
+    n = *(volatile int*)&lk->n;
+    if(n >= 0 && *(volatile uint*)&lk->writers == 0 &&
+       __sync_bool_compare_and_swap(&lk->n, n, n+1))
+      break;
+    spins++;
+  }
+  __sync_synchronize();
+
+  // readers share the statistics, so update them atomically.
+  __sync_fetch_and_add(&lk->stat.nacquire, 1);
+  if(spins){
+    __sync_fetch_and_add(&lk->stat.ncontend, 1);
+    __sync_fetch_and_add(&lk->stat.nspin, spins);
+  }
+}
+
+void
+releaseread(struct rwspinlock *lk)
+{
+  __sync_synchronize();
+  if(__sync_fetch_and_sub(&lk->n, 1) <= 0)
+    panic("releaseread");
+  pop_off();
+}
+
+void
+acquirewrite(struct rwspinlock *lk)
+{
+  uint64 spins = 0;
+
+  push_off(); // disable interrupts to avoid deadlock.
+  __sync_fetch_and_add(&lk->writers, 1);
+  while(!__sync_bool_compare_and_swap(&lk->n, 0, -1))
+    spins++;
+  __sync_fetch_and_sub(&lk->writers, 1);
+  __sync_synchronize();
+
+  // The writer's statistics are protected by the lock, but
+  // readers may be updating the shared counters.
+  __sync_fetch_and_add(&lk->stat.nacquire, 1);
+  if(spins){
+    __sync_fetch_and_add(&lk->stat.ncontend, 1);
+    __sync_fetch_and_add(&lk->stat.nspin, spins);
+  }
+  lk->stat.start = r_time();
+}
+
+void
+releasewrite(struct rwspinlock *lk)
+{
+  uint64 hold;
+
+  if(lk->n != -1)
+    panic("releasewrite");
+
+  // only writers record their hold time.
+  hold = r_time() - lk->stat.start;
+  if(hold > lk->stat.maxhold)
+    lk->stat.maxhold = hold;
+
+  __sync_synchronize();
+  __sync_lock_release(&lk->n);
+  pop_off();
+}
@@ -0,0 +1,10 @@
+// Reader-writer spin lock: any number of readers, or one writer.
+struct rwspinlock {
+  int n;             // Readers holding the lock, or -1 for a writer.
+  uint writers;      // Writers waiting; new readers hold back for them.
+
+  // For debugging:
+  char *name;        // Name of lock.
+
+  struct lockstat stat;
+};
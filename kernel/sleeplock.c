@@ -1,4 +1,10 @@
 // Sleeping locks
+//
+// Sleeplocks are adaptive: a process that finds the lock held
+// spins for a while, as long as the holder is running on
+// another hart, since the holder will likely release it soon.
+// It sleeps if the holder is not running, or is still holding
+// the lock once the spin budget is used up.
 
 #include "types.h"
 #include "riscv.h"
@@ -9,34 +15,106 @@
 #include "proc.h"
 #include "sleeplock.h"
 
+#define SPINCYCLES 200   // spin budget, in CLINT_MTIME cycles (20us)
+
 void
 initsleeplock(struct sleeplock *lk, char *name)
 {
-  initlock(&lk->lk, "sleep lock");
+  // only the sleeplock itself is tracked, not its spinlock,
+  // so that each one takes a single lockstat slot.
+  initsleeplocknostat(lk, name);
+  lockstatadd(name, "sleep", &lk->stat);
+}
+
+// Like initsleeplock(), but leave the lock off the statistics
+// list (see initlocknostat()).
+void
+initsleeplocknostat(struct sleeplock *lk, char *name)
+{
+  initlocknostat(&lk->lk, "sleep lock");
   lk->name = name;
   lk->locked = 0;
   lk->pid = 0;
+  lk->waiters = 0;
+}
+
+// Spin, without lk->lk, while lk is held by the same running
+// process and the budget lasts. Returns with lk->lk held.
+static void
+spinsleep(struct sleeplock *lk)
+{
+  int pid = lk->pid;
+  struct proc *owner;
+  uint64 deadline;
+
+  release(&lk->lk);
+  // looked up once; the loop re-checks that it is still
+  // the owner, since the slot may be reused at any time.
+  owner = findproc(pid);
+  deadline = r_time() + SPINCYCLES;
+  while(owner && *(volatile uint*)&lk->locked &&
+        *(volatile int*)&lk->pid == pid &&
+        *(volatile int*)&owner->pid == pid &&
+        *(volatile enum procstate*)&owner->state == RUNNING &&
+        r_time() < deadline)
+    ;
+  acquire(&lk->lk);
 }
 
 void
 acquiresleep(struct sleeplock *lk)
 {
   acquire(&lk->lk);
+  if(lk->locked){
+    lk->stat.ncontend++;
+    spinsleep(lk);
+  }
   while (lk->locked) {
+    lk->stat.nspin++;
+    lk->waiters++;
     sleep(lk, &lk->lk);
+    lk->waiters--;
   }
   lk->locked = 1;
   lk->pid = myproc()->pid;
+  lk->stat.nacquire++;
+  lk->stat.start = r_time();
+  release(&lk->lk);
+}
+
+// Acquire lk only if no one holds it.
+// Returns 1 if it did, 0 if not.
+int
+tryacquiresleep(struct sleeplock *lk)
+{
+  int ok;
+
+  acquire(&lk->lk);
+  ok = !lk->locked;
+  if(ok){
+    lk->locked = 1;
+    lk->pid = myproc()->pid;
+    lk->stat.nacquire++;
+    lk->stat.start = r_time();
+  }
   release(&lk->lk);
+  return ok;
 }
 
 void
 releasesleep(struct sleeplock *lk)
 {
+  uint64 hold;
+
   acquire(&lk->lk);
+  hold = r_time() - lk->stat.start;
+  if(hold > lk->stat.maxhold)
+    lk->stat.maxhold = hold;
   lk->locked = 0;
   lk->pid = 0;
-  wakeup(lk);
+  // wakeup() scans every process; skip it if no one sleeps.
+  if(lk->waiters)
+    wakeup(lk);
   release(&lk->lk);
 }
 
@@ -6,5 +6,8 @@ struct sleeplock {
   // For debugging:
   char *name;        // Name of lock.
   int pid;           // Process holding lock
+  int waiters;       // Processes asleep in acquiresleep()
+
+  struct lockstat stat;
 };
 
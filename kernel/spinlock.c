@@ -8,29 +8,307 @@
 #include "proc.h"
 #include "defs.h"
 
+// Every initialized lock is listed here, alone or in a group
+// (lockstatgroup()), so that statslock() can report its
+// statistics; initlocknostat() makes the exceptions. Locks
+// that live in memory that is later freed must be taken off
+// the list with freelock().
+// lockstats.lock itself is used without initlock(), and so
+// is not on the list. It is a leaf lock, so that locks can
+// be added and removed from any context, including the
+// kalloc() shrinkers.
+static struct {
+  struct spinlock lock;
+  struct {
+    char *name;
+    char *kind;               // "spin", "sleep" or "rw"
+    struct lockstat *stat;    // the first of n, stride bytes apart
+    int n;
+    int stride;
+  } locks[NLOCK];
+  int full;                   // a lock found no room
+} lockstats;
+
+// The i'th statistics of entry e.
+static struct lockstat*
+statat(int e, int i)
+{
+  return (struct lockstat*)((char*)lockstats.locks[e].stat + i*lockstats.locks[e].stride);
+}
+
+// Start tracking the statistics of n locks of the same kind,
+// stride bytes apart from st on, as if they were one lock.
+// An entry that is added again keeps its slot.
+void
+lockstatgroup(char *name, char *kind, struct lockstat *st, int n, int stride)
+{
+  int i, slot = -1, warn = 0;
+
+  for(i = 0; i < n; i++)
+    memset((char*)st + i*stride, 0, sizeof(*st));
+  acquire(&lockstats.lock);
+  for(i = 0; i < NLOCK; i++){
+    if(lockstats.locks[i].stat == st){
+      slot = i;
+      break;
+    }
+    if(slot < 0 && lockstats.locks[i].stat == 0)
+      slot = i;
+  }
+  if(slot >= 0){
+    lockstats.locks[slot].name = name;
+    lockstats.locks[slot].kind = kind;
+    lockstats.locks[slot].stat = st;
+    lockstats.locks[slot].n = n;
+    lockstats.locks[slot].stride = stride;
+  } else if(!lockstats.full){
+    lockstats.full = 1;
+    warn = 1;
+  }
+  release(&lockstats.lock);
+  // a full table leaves the lock untracked; say so once.
+  if(warn)
+    printf("lockstat: no room for %s; raise NLOCK\n", name);
+}
+
+// Start tracking the statistics of a lock.
+void
+lockstatadd(char *name, char *kind, struct lockstat *st)
+{
+  lockstatgroup(name, kind, st, 1, 0);
+}
+
+// Stop tracking the statistics of a lock.
+void
+lockstatremove(struct lockstat *st)
+{
+  acquire(&lockstats.lock);
+  for(int i = 0; i < NLOCK; i++){
+    if(lockstats.locks[i].stat == st){
+      lockstats.locks[i].stat = 0;
+      break;
+    }
+  }
+  release(&lockstats.lock);
+}
+
+// Zero the statistics of every lock.
+void
+lockstatreset(void)
+{
+  acquire(&lockstats.lock);
+  for(int i = 0; i < NLOCK; i++){
+    if(lockstats.locks[i].stat == 0)
+      continue;
+    for(int j = 0; j < lockstats.locks[i].n; j++){
+      struct lockstat *st = statat(i, j);
+      st->nacquire = 0;
+      st->ncontend = 0;
+      st->nspin = 0;
+      st->maxhold = 0;
+    }
+  }
+  release(&lockstats.lock);
+}
+
+// Format one line per lock (or group of locks) that has
+// been acquired:
+//   name spin|sleep|rw acquisitions contended spins maxhold
+// A group's line has the sums of its locks' counters, and the
+// longest of their holds. The counters are read without the
+// locks they describe, so a line may be slightly out of date.
+int
+statslock(char *buf, int sz)
+{
+  struct lockstat sum;
+  int n = 0;
+
+  acquire(&lockstats.lock);
+  for(int i = 0; i < NLOCK && n < sz; i++){
+    if(lockstats.locks[i].stat == 0)
+      continue;
+    memset(&sum, 0, sizeof(sum));
+    for(int j = 0; j < lockstats.locks[i].n; j++){
+      struct lockstat *st = statat(i, j);
+      sum.nacquire += st->nacquire;
+      sum.ncontend += st->ncontend;
+      sum.nspin += st->nspin;
+      if(st->maxhold > sum.maxhold)
+        sum.maxhold = st->maxhold;
+    }
+    if(sum.nacquire == 0)
+      continue;
+    n += snprintf(buf+n, sz-n, "%s %s %l %l %l %l\n",
+                  lockstats.locks[i].name, lockstats.locks[i].kind,
+                  sum.nacquire, sum.ncontend, sum.nspin, sum.maxhold);
+  }
+  release(&lockstats.lock);
+  return n;
+}
+
+// Each hart's MCS queue nodes, one per MCS lock it may be
+// holding or waiting for at once. A hart only touches its own
+// pool, with interrupts off, so the pool needs no lock.
+#define NMCSNODE 8
+
+static struct {
+  struct mcsnode node[NMCSNODE];
+  uint used;                    // bitmap of nodes in use
+} mcspool[NCPU];
+
+static struct mcsnode*
+mcsalloc(void)
+{
+  int id = cpuid();
+
+  for(int i = 0; i < NMCSNODE; i++){
+    if((mcspool[id].used & (1 << i)) == 0){
+      mcspool[id].used |= 1 << i;
+      return &mcspool[id].node[i];
+    }
+  }
+  panic("mcsalloc");
+}
+
+static void
+mcsfree(struct mcsnode *n)
+{
+  int id = cpuid();
+
+  mcspool[id].used &= ~(1 << (n - mcspool[id].node));
+}
+
 void
 initlock(struct spinlock *lk, char *name)
+{
+  initlocktype(lk, name, LOCK_TAS);
+}
+
+// Like initlock(), but for a lock of the given LOCK_ type.
+// Ticket and MCS locks hand the lock to waiters in the order
+// they arrived, and an MCS waiter spins on a cache line of its
+// own rather than on the lock; both help heavily contended locks.
+void
+initlocktype(struct spinlock *lk, char *name, int type)
+{
+  initlocknostat(lk, name);
+  lk->type = type;
+  lockstatadd(name, "spin", &lk->stat);
+}
+
+// Like initlock(), but leave the lock off the statistics list,
+// for locks made and freed in bulk that would crowd everything
+// else out of it, or that lockstatgroup() tracks together.
+// Such a lock needs no freelock().
+void
+initlocknostat(struct spinlock *lk, char *name)
 {
   lk->name = name;
   lk->locked = 0;
+  lk->type = LOCK_TAS;
+  lk->next = 0;
+  lk->serving = 0;
+  lk->tail = 0;
+  lk->node = 0;
   lk->cpu = 0;
 }
 
+// Called before the memory holding lk is freed.
+void
+freelock(struct spinlock *lk)
+{
+  lockstatremove(&lk->stat);
+}
+
+// Take a ticket and wait for it to be served.
+// Returns the number of times it had to look again.
+static uint64
+ticketacquire(struct spinlock *lk)
+{
+  uint64 spins = 0;
+  uint ticket;
+
+  // On RISC-V, this turns into amoadd.w.
+  ticket = __sync_fetch_and_add(&lk->next, 1);
+  while(*(volatile uint*)&lk->serving != ticket)
+    spins++;
+  return spins;
+}
+
+// Join the end of the queue, then wait on our own node until
+// our predecessor hands the lock over.
+static uint64
+mcsacquire(struct spinlock *lk)
+{
+  uint64 spins = 0;
+  struct mcsnode *n, *pred;
+
+  n = mcsalloc();
+  n->next = 0;
+  n->locked = 1;
+  __sync_synchronize();
+  pred = __sync_lock_test_and_set(&lk->tail, n);
+  if(pred){
+    __sync_synchronize();
+    *(struct mcsnode* volatile*)&pred->next = n;
+    while(*(volatile uint*)&n->locked)
+      spins++;
+  }
+  lk->node = n;
+  return spins;
+}
+
+// Hand the lock to the next waiter, if any.
+static void
+mcsrelease(struct spinlock *lk)
+{
+  struct mcsnode *n = lk->node;
+  struct mcsnode *next;
+
+  lk->node = 0;
+  next = *(struct mcsnode* volatile*)&n->next;
+  if(next == 0){
+    // no known successor: try to mark the queue empty.
+    if(__sync_bool_compare_and_swap(&lk->tail, n, 0)){
+      mcsfree(n);
+      return;
+    }
+    // someone is joining; wait until it links itself in.
+    while((next = *(struct mcsnode* volatile*)&n->next) == 0)
+      ;
+  }
+  __sync_synchronize();
+  next->locked = 0;
+  mcsfree(n);
+}
+
 // Acquire the lock.
 // Loops (spins) until the lock is acquired.
 void
 acquire(struct spinlock *lk)
 {
+  uint64 spins = 0;
+
   push_off(); // disable interrupts to avoid deadlock.
   if(holding(lk))
     panic("acquire");
 
-  // On RISC-V, sync_lock_test_and_set turns into an atomic swap:
-  //   a5 = 1
-  //   s1 = &lk->locked
-  //   amoswap.w.aq a5, a5, (s1)
-  while(__sync_lock_test_and_set(&lk->locked, 1) != 0)
-    ;
+  switch(lk->type){
+  case LOCK_TICKET:
+    spins = ticketacquire(lk);
+    break;
+  case LOCK_MCS:
+    spins = mcsacquire(lk);
+    break;
+  default:
+    // On RISC-V, sync_lock_test_and_set turns into an atomic swap:
+    //   a5 = 1
+    //   s1 = &lk->locked
+    //   amoswap.w.aq a5, a5, (s1)
+    while(__sync_lock_test_and_set(&lk->locked, 1) != 0)
+      spins++;
+    break;
+  }
 
   // Tell the C compiler and the processor to not move loads or stores
   // past this point, to ensure that the critical section's memory
@@ -39,17 +317,35 @@ acquire(struct spinlock *lk)
   __sync_synchronize();
 
   // Record info about lock acquisition for holding() and debugging.
+  // For ticket and MCS locks, locked is only this record.
+  lk->locked = 1;
   lk->cpu = mycpu();
+
+  // The statistics are protected by the lock itself.
+  lk->stat.nacquire++;
+  if(spins){
+    lk->stat.ncontend++;
+    lk->stat.nspin += spins;
+  }
+  lk->stat.start = r_time();
 }
 
 // Release the lock.
 void
 release(struct spinlock *lk)
 {
+  uint64 hold;
+
   if(!holding(lk))
     panic("release");
 
+  hold = r_time() - lk->stat.start;
+  if(hold > lk->stat.maxhold)
+    lk->stat.maxhold = hold;
+
   lk->cpu = 0;
+  if(lk->type != LOCK_TAS)
+    lk->locked = 0;
 
   // Tell the C compiler and the CPU to not move loads or stores
   // past this point, to ensure that all the stores in the critical
@@ -59,14 +355,25 @@ release(struct spinlock *lk)
   // On RISC-V, this emits a fence instruction.
   __sync_synchronize();
 
-  // Release the lock, equivalent to lk->locked = 0.
-  // This code doesn't use a C assignment, since the C standard
-  // implies that an assignment might be implemented with
-  // multiple store instructions.
-  // On RISC-V, sync_lock_release turns into an atomic swap:
-  //   s1 = &lk->locked
-  //   amoswap.w zero, zero, (s1)
-  __sync_lock_release(&lk->locked);
+  switch(lk->type){
+  case LOCK_TICKET:
+    // serve the next ticket.
+    __sync_fetch_and_add(&lk->serving, 1);
+    break;
+  case LOCK_MCS:
+    mcsrelease(lk);
+    break;
+  default:
+    // Release the lock, equivalent to lk->locked = 0.
+    // This code doesn't use a C assignment, since the C standard
+    // implies that an assignment might be implemented with
+    // multiple store instructions.
+    // On RISC-V, sync_lock_release turns into an atomic swap:
+    //   s1 = &lk->locked
+    //   amoswap.w zero, zero, (s1)
+    __sync_lock_release(&lk->locked);
+    break;
+  }
 
   pop_off();
 }
@@ -1,9 +1,41 @@
+// Contention statistics kept by every spinlock and sleeplock,
+// and reported through the statistics device (see lockstat).
+struct lockstat {
+  uint64 nacquire;   // Number of acquisitions.
+  uint64 ncontend;   // Acquisitions that found the lock held.
+  uint64 nspin;      // Failed test-and-sets, or sleeps for a sleeplock.
+  uint64 maxhold;    // Longest hold, in CLINT_MTIME cycles.
+  uint64 start;      // When the current holder acquired it.
+};
+
+// Lock types, chosen with initlocktype().
+#define LOCK_TAS     0  // test-and-set; the default
+#define LOCK_TICKET  1  // waiters served in arrival order
+#define LOCK_MCS     2  // FIFO queue; each waiter spins on its own node
+
+// A waiter's place in an MCS lock's queue.
+// Each hart has a few of these; see spinlock.c.
+struct mcsnode {
+  struct mcsnode *next;  // next waiter
+  uint locked;           // does this waiter still have to wait?
+} __attribute__((aligned(64)));
+
 // Mutual exclusion lock.
 struct spinlock {
   uint locked;       // Is the lock held?
+  int type;          // LOCK_TAS, LOCK_TICKET or LOCK_MCS.
+
+  // For LOCK_TICKET:
+  uint next;         // Next ticket to hand out.
+  uint serving;      // Ticket of the holder.
+
+  // For LOCK_MCS:
+  struct mcsnode *tail;  // Last waiter in the queue, or 0.
+  struct mcsnode *node;  // The holder's queue node.
 
   // For debugging:
   char *name;        // Name of lock.
   struct cpu *cpu;   // The cpu holding the lock.
-};
 
+  struct lockstat stat;
+};
@@ -0,0 +1,88 @@
+#include <stdarg.h>
+
+#include "types.h"
+#include "param.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+#include "riscv.h"
+#include "defs.h"
+
+static char digits[] = "0123456789abcdef";
+
+// Append the digits of x to buf, without running past sz.
+static int
+sprintint(char *buf, int sz, uint64 x, int base, int neg)
+{
+  char tmp[24];
+  int i, n;
+
+  i = 0;
+  do {
+    tmp[i++] = digits[x % base];
+  } while((x /= base) != 0);
+
+  if(neg)
+    tmp[i++] = '-';
+
+  n = 0;
+  while(--i >= 0 && n < sz)
+    buf[n++] = tmp[i];
+  return n;
+}
+
+// Format into buf, like printf(). Understands %d, %l (64-bit
+// unsigned), %x, %s and %%. Writes at most sz bytes, with no
+// terminating 0, and returns the number written.
+int
+snprintf(char *buf, int sz, char *fmt, ...)
+{
+  va_list ap;
+  int i, c, x;
+  int off = 0;
+  char *s;
+
+  if (fmt == 0)
+    panic("null fmt");
+
+  va_start(ap, fmt);
+  for(i = 0; off < sz && (c = fmt[i] & 0xff) != 0; i++){
+    if(c != '%'){
+      buf[off++] = c;
+      continue;
+    }
+    c = fmt[++i] & 0xff;
+    if(c == 0)
+      break;
+    switch(c){
+    case 'd':
+      x = va_arg(ap, int);
+      off += sprintint(buf+off, sz-off, x < 0 ? -(uint64)x : x, 10, x < 0);
+      break;
+    case 'l':
+      off += sprintint(buf+off, sz-off, va_arg(ap, uint64), 10, 0);
+      break;
+    case 'x':
+      off += sprintint(buf+off, sz-off, va_arg(ap, uint), 16, 0);
+      break;
+    case 's':
+      if((s = va_arg(ap, char*)) == 0)
+        s = "(null)";
+      for(; *s && off < sz; s++)
+        buf[off++] = *s;
+      break;
+    case '%':
+      buf[off++] = '%';
+      break;
+    default:
+      // Print unknown % sequence to draw attention.
+      buf[off++] = '%';
+      if(off < sz)
+        buf[off++] = c;
+      break;
+    }
+  }
+  va_end(ap);
+  return off;
+}
@@ -0,0 +1,75 @@
+// The statistics device.
+//
+// Reading it returns a text snapshot of the kernel's counters,
+// taken when a reader starts at the beginning; the snapshot is
+// then handed out across successive reads until it runs out.
+// Writing anything to it resets the counters.
+
+#include "types.h"
+#include "param.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+#include "riscv.h"
+#include "defs.h"
+
+#define BUFSZ (4*4096)
+
+static struct {
+  struct spinlock lock;
+  char buf[BUFSZ];
+  int sz;
+  int off;
+} stats;
+
+int
+statswrite(int user_src, uint64 src, int n)
+{
+  lockstatreset();
+  return n;
+}
+
+int
+statsread(int user_dst, uint64 dst, int n)
+{
+  int m;
+
+  acquire(&stats.lock);
+
+  if(stats.sz == 0) {
+    // the short, fixed-size reports first, so that a long
+    // lock table cannot crowd them out of the buffer.
+    stats.sz = statsdisk(stats.buf, BUFSZ);
+    stats.sz += statsbcache(stats.buf+stats.sz, BUFSZ-stats.sz);
+    stats.sz += statslock(stats.buf+stats.sz, BUFSZ-stats.sz);
+    stats.off = 0;
+  }
+  m = stats.sz - stats.off;
+
+  if (m > 0) {
+    if(m > n)
+      m  = n;
+    if(either_copyout(user_dst, dst, stats.buf+stats.off, m) == -1) {
+      release(&stats.lock);
+      return -1;
+    }
+    stats.off += m;
+  } else {
+    // end of this snapshot; the next read starts a new one.
+    m = 0;
+    stats.sz = 0;
+    stats.off = 0;
+  }
+  release(&stats.lock);
+  return m;
+}
+
+void
+statsinit(void)
+{
+  initlock(&stats.lock, "stats");
+
+  devsw[STATS].read = statsread;
+  devsw[STATS].write = statswrite;
+}
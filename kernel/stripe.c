@@ -0,0 +1,266 @@
+// Striped (RAID-0) volume.
+//
+// Presents several disks as one device. Logical blocks go to
+// the members round robin, STRIPESZ at a time, so that a long
+// transfer keeps every member busy: logical block lb is block
+// (lb / STRIPESZ / n) * STRIPESZ + lb % STRIPESZ of member
+// (lb / STRIPESZ) % n. mkfs -s lays out an image pair the same
+// way.
+//
+// A request from the scheduler is split where it crosses from
+// one member to the next, into pieces that each go to one
+// member as a request of their own. The pieces share the
+// request's buffers: each piece's chain is cut out of the
+// request's qnext chain, which is stitched back together when
+// the last piece is done.
+//
+// A member may have no room for a piece when it is split; the
+// piece then waits on a retry list and is sent again when some
+// other piece is done. Members must finish requests
+// asynchronously (submit never returns 1), as virtio disks do.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "buf.h"
+#include "iosched.h"
+#include "bdev.h"
+#include "defs.h"
+
+// the scheduler has at most 16 requests in flight, each of at
+// most MAXSEG blocks, so MAXSEG/STRIPESZ+1 pieces.
+#define NPIECE 128
+
+struct piece {
+  struct ioreq r;         // what the member sees
+  struct bdev *member;
+  struct ioreq *parent;   // the request this is a piece of
+  struct piece *first;    // parent's first piece
+  struct piece *next;     // parent's next piece, in block order; or next free
+  struct piece *retry;    // next on the retry list
+  int pending;            // in the first piece: pieces not done
+};
+
+static struct {
+  struct spinlock lock;
+  struct piece piece[NPIECE];
+  struct piece *free;
+  struct piece *retry;    // pieces to send when a member has room
+  struct bdev *member[NVIRTIO];
+  int n;
+  struct bdev bdev;
+} stripe;
+
+static void piecedone(struct ioreq*);
+
+// Which member holds logical block lb, and where.
+static int
+locate(uint lb, uint *mb)
+{
+  uint su = lb / STRIPESZ;
+
+  *mb = su / stripe.n * STRIPESZ + lb % STRIPESZ;
+  return su % stripe.n;
+}
+
+// Put the chain of the pieces' parent back together, and free
+// the pieces. Caller must hold stripe.lock.
+static void
+unsplit(struct piece *first)
+{
+  struct piece *p, *np;
+
+  for(p = first; p; p = np){
+    np = p->next;
+    p->r.tail->qnext = np ? np->r.head : 0;
+    p->next = stripe.free;
+    stripe.free = p;
+  }
+}
+
+static int
+stripesubmit(struct bdev *bd, struct ioreq *r)
+{
+  struct piece *p, *first = 0, **pp = &first;
+  struct buf *b;
+  uint lb, mb;
+  int i, k, m, rc, sent = 0;
+
+  acquire(&stripe.lock);
+
+  // cut r into pieces that each stay within one stripe unit.
+  for(b = r->head, lb = r->blockno; b; b = b->qnext, lb += i){
+    if((p = stripe.free) == 0){
+      // r's chain is still whole; just give the pieces back.
+      stripe.free = first;
+      release(&stripe.lock);
+      return -1;
+    }
+    stripe.free = p->next;
+    m = locate(lb, &mb);
+    p->member = stripe.member[m];
+    p->parent = r;
+    p->r.dev = r->dev;
+    p->r.blockno = mb;
+    p->r.write = r->write;
+    p->r.async = r->async;
+    p->r.done = piecedone;
+    p->r.head = b;
+    k = STRIPESZ - lb % STRIPESZ;
+    for(i = 1; i < k && b->qnext; i++)
+      b = b->qnext;
+    p->r.tail = b;
+    p->r.n = i;
+    p->next = 0;
+    *pp = p;
+    pp = &p->next;
+  }
+  first->pending = 0;
+  for(p = first; p; p = p->next){
+    p->first = first;
+    p->r.tail->qnext = 0;
+    first->pending++;
+  }
+
+  for(p = first; p; p = p->next){
+    if((rc = p->member->submit(p->member, &p->r)) < 0){
+      if(sent == 0){
+        unsplit(first);
+        release(&stripe.lock);
+        return -1;
+      }
+      // some of r is on its way; the rest waits for room.
+      for(; p; p = p->next){
+        p->retry = stripe.retry;
+        stripe.retry = p;
+      }
+      break;
+    }
+    sent++;
+    if(rc == 1)
+      first->pending--;
+  }
+  if(first->pending == 0){
+    unsplit(first);
+    release(&stripe.lock);
+    return 1;
+  }
+  release(&stripe.lock);
+  return 0;
+}
+
+// Send the pieces that were waiting for room, if there is room
+// now. Caller must hold stripe.lock.
+static void
+resend(void)
+{
+  struct piece *p, *list = stripe.retry;
+  int rc;
+
+  stripe.retry = 0;
+  while((p = list) != 0){
+    list = p->retry;
+    if((rc = p->member->submit(p->member, &p->r)) < 0){
+      p->retry = stripe.retry;
+      stripe.retry = p;
+    } else if(rc == 1){
+      panic("stripe: member finished at once");
+    }
+  }
+}
+
+// A member has finished piece r. Called from its interrupt
+// handler, or while polling.
+static void
+piecedone(struct ioreq *r)
+{
+  struct piece *p = (struct piece*)r;
+  struct piece *first = p->first;
+  struct ioreq *parent = 0;
+
+  acquire(&stripe.lock);
+  if(--first->pending == 0){
+    parent = first->parent;
+    unsplit(first);
+  }
+  resend();
+  release(&stripe.lock);
+
+  if(parent)
+    parent->done(parent);
+}
+
+// the members are used up to the smallest one.
+static uint
+stripecapacity(struct bdev *bd)
+{
+  uint min = ~0U, c;
+
+  for(int i = 0; i < stripe.n; i++){
+    c = stripe.member[i]->capacity(stripe.member[i]);
+    if(c < min)
+      min = c;
+  }
+  return min / STRIPESZ * STRIPESZ * stripe.n;
+}
+
+static void
+stripeflush(struct bdev *bd)
+{
+  for(int i = 0; i < stripe.n; i++)
+    if(stripe.member[i]->flush)
+      stripe.member[i]->flush(stripe.member[i]);
+}
+
+static void
+stripepollstart(struct bdev *bd)
+{
+  for(int i = 0; i < stripe.n; i++)
+    if(stripe.member[i]->pollstart)
+      stripe.member[i]->pollstart(stripe.member[i]);
+}
+
+static void
+stripepoll(struct bdev *bd)
+{
+  for(int i = 0; i < stripe.n; i++)
+    if(stripe.member[i]->poll)
+      stripe.member[i]->poll(stripe.member[i]);
+}
+
+static void
+stripepollend(struct bdev *bd)
+{
+  for(int i = 0; i < stripe.n; i++)
+    if(stripe.member[i]->pollend)
+      stripe.member[i]->pollend(stripe.member[i]);
+}
+
+// Make disk dev a stripe over the n devices in member.
+void
+stripeinit(uint dev, struct bdev **member, int n)
+{
+  if(n < 2 || n > NVIRTIO)
+    panic("stripeinit");
+  initlock(&stripe.lock, "stripe");
+  for(int i = 0; i < NPIECE; i++){
+    stripe.piece[i].next = stripe.free;
+    stripe.free = &stripe.piece[i];
+  }
+  for(int i = 0; i < n; i++)
+    stripe.member[i] = member[i];
+  stripe.n = n;
+
+  stripe.bdev.name = "stripe";
+  stripe.bdev.submit = stripesubmit;
+  stripe.bdev.flush = stripeflush;
+  stripe.bdev.capacity = stripecapacity;
+  stripe.bdev.pollstart = stripepollstart;
+  stripe.bdev.poll = stripepoll;
+  stripe.bdev.pollend = stripepollend;
+  bdevregister(dev, &stripe.bdev);
+}
@@ -5,6 +5,7 @@
 #include "spinlock.h"
 #include "proc.h"
 #include "syscall.h"
+#include "sysstat.h"
 #include "defs.h"
 
 // Fetch the uint64 at addr from the current process.
@@ -104,6 +105,15 @@ extern uint64 sys_unlink(void);
 extern uint64 sys_wait(void);
 extern uint64 sys_write(void);
 extern uint64 sys_uptime(void);
+extern uint64 sys_nanosleep(void);
+extern uint64 sys_sysstat(void);
+extern uint64 sys_trace(void);
+extern uint64 sys_prof_start(void);
+extern uint64 sys_prof_stop(void);
+extern uint64 sys_prof_read(void);
+extern uint64 sys_ktrace(void);
+extern uint64 sys_ktrace_read(void);
+extern uint64 sys_sysctl(void);
 
 static uint64 (*syscalls[])(void) = {
 [SYS_fork]    sys_fork,
@@ -127,20 +137,143 @@ static uint64 (*syscalls[])(void) = {
 [SYS_link]    sys_link,
 [SYS_mkdir]   sys_mkdir,
 [SYS_close]   sys_close,
+[SYS_nanosleep] sys_nanosleep,
+[SYS_sysstat] sys_sysstat,
+[SYS_trace]   sys_trace,
+[SYS_prof_start] sys_prof_start,
+[SYS_prof_stop] sys_prof_stop,
+[SYS_prof_read] sys_prof_read,
+[SYS_ktrace]  sys_ktrace,
+[SYS_ktrace_read] sys_ktrace_read,
+[SYS_sysctl]  sys_sysctl,
 };
 
+static char *syscallnames[] = {
+[SYS_fork]    "fork",
+[SYS_exit]    "exit",
+[SYS_wait]    "wait",
+[SYS_pipe]    "pipe",
+[SYS_read]    "read",
+[SYS_kill]    "kill",
+[SYS_exec]    "exec",
+[SYS_fstat]   "fstat",
+[SYS_chdir]   "chdir",
+[SYS_dup]     "dup",
+[SYS_getpid]  "getpid",
+[SYS_sbrk]    "sbrk",
+[SYS_sleep]   "sleep",
+[SYS_uptime]  "uptime",
+[SYS_open]    "open",
+[SYS_write]   "write",
+[SYS_mknod]   "mknod",
+[SYS_unlink]  "unlink",
+[SYS_link]    "link",
+[SYS_mkdir]   "mkdir",
+[SYS_close]   "close",
+[SYS_nanosleep] "nanosleep",
+[SYS_sysstat] "sysstat",
+[SYS_trace]   "trace",
+[SYS_prof_start] "prof_start",
+[SYS_prof_stop] "prof_stop",
+[SYS_prof_read] "prof_read",
+[SYS_ktrace]  "ktrace",
+[SYS_ktrace_read] "ktrace_read",
+[SYS_sysctl]  "sysctl",
+};
+
+// per-hart counters, so that syscall() never shares
+// a cache line with another hart. a hart only updates
+// its own entries, with interrupts off.
+static struct {
+  uint64 count;
+  uint64 errors;
+  uint64 cycles;
+  uint64 hist[NSYSHIST];
+} sysstats[NCPU][NELEM(syscalls)];
+
+// record one call of system call num that took cycles.
+static void
+sysstatrecord(int num, uint64 ret, uint64 cycles)
+{
+  int b = 0;
+
+  while(b < NSYSHIST-1 && (cycles >> (b+1)) != 0)
+    b++;
+
+  push_off();
+  int id = cpuid();
+  sysstats[id][num].count++;
+  if(ret == -1)
+    sysstats[id][num].errors++;
+  sysstats[id][num].cycles += cycles;
+  sysstats[id][num].hist[b]++;
+  pop_off();
+}
+
 void
 syscall(void)
 {
   int num;
+  uint64 t0;
   struct proc *p = myproc();
 
   num = p->trapframe->a7;
   if(num > 0 && num < NELEM(syscalls) && syscalls[num]) {
+    t0 = r_time();
     p->trapframe->a0 = syscalls[num]();
+    sysstatrecord(num, p->trapframe->a0, r_time() - t0);
+    if(p->tracemask & (1 << num))
+      printf("%d: syscall %s -> %d\n",
+             p->pid, syscallnames[num], (int)p->trapframe->a0);
   } else {
     printf("%d %s: unknown sys call %d\n",
             p->pid, p->name, num);
     p->trapframe->a0 = -1;
   }
 }
+
+// Copy the statistics of up to n system calls, summed over
+// all harts, to the array of struct syscallstat at addr.
+// Entry i describes system call number i.
+// Returns the number of entries copied, or -1.
+uint64
+sys_sysstat(void)
+{
+  uint64 addr;
+  int n, num, id, b;
+  struct syscallstat st;
+  struct proc *p = myproc();
+
+  if(argaddr(0, &addr) < 0 || argint(1, &n) < 0 || n < 0)
+    return -1;
+  if(n > NELEM(syscalls))
+    n = NELEM(syscalls);
+  for(num = 0; num < n; num++){
+    memset(&st, 0, sizeof(st));
+    if(syscallnames[num])
+      safestrcpy(st.name, syscallnames[num], sizeof(st.name));
+    for(id = 0; id < NCPU; id++){
+      st.count += sysstats[id][num].count;
+      st.errors += sysstats[id][num].errors;
+      st.cycles += sysstats[id][num].cycles;
+      for(b = 0; b < NSYSHIST; b++)
+        st.hist[b] += sysstats[id][num].hist[b];
+    }
+    if(copyout(p->pagetable, addr + num*sizeof(st), (char*)&st, sizeof(st)) < 0)
+      return -1;
+  }
+  return n;
+}
+
+// Print a line for each later system call of this
+// process (and its children) whose bit is set in mask.
+uint64
+sys_trace(void)
+{
+  int mask;
+
+  if(argint(0, &mask) < 0)
+    return -1;
+  myproc()->tracemask = mask;
+  return 0;
+}
@@ -20,3 +20,12 @@
 #define SYS_link   19
 #define SYS_mkdir  20
 #define SYS_close  21
+#define SYS_nanosleep 22
+#define SYS_sysstat 23
+#define SYS_trace  24
+#define SYS_prof_start 25
+#define SYS_prof_stop 26
+#define SYS_prof_read 27
+#define SYS_ktrace 28
+#define SYS_ktrace_read 29
+#define SYS_sysctl 30
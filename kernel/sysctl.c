@@ -0,0 +1,30 @@
+// Kernel tunables.
+//
+// sysctl(name, value) sets the tunable called name (see
+// sysctl.h) to value, unless value is -1, and returns its
+// previous value, or -1 if name or value is no good.
+
+#include "types.h"
+#include "param.h"
+#include "riscv.h"
+#include "sysctl.h"
+#include "defs.h"
+
+uint64
+sys_sysctl(void)
+{
+  int name, value;
+
+  if(argint(0, &name) < 0 || argint(1, &value) < 0)
+    return -1;
+
+  switch(name){
+  case CTL_BCACHEPOLICY:
+    return bsetpolicy(value);
+  case CTL_BCACHEMAX:
+    return bsetmax(value);
+  case CTL_DISKPOLL:
+    return disk_setpoll(value);
+  }
+  return -1;
+}
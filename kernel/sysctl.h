@@ -0,0 +1,9 @@
+// Names of kernel tunables, for sysctl(name, value).
+// Both the kernel and user programs use this header file.
+
+#define CTL_BCACHEPOLICY 1  // buffer replacement policy: BPOL_*
+#define CTL_BCACHEMAX    2  // most buffers the block cache may hold; 0 for no limit
+#define CTL_DISKPOLL     3  // 1: poll for disk completions before sleeping
+
+#define BPOL_LRU 0  // least recently used
+#define BPOL_2Q  1  // 2Q: blocks seen once cannot push out re-used ones
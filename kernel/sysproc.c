@@ -52,25 +52,60 @@ sys_sbrk(void)
   return addr;
 }
 
+// CLINT_MTIME once another cycles have passed, or ~0
+// (never) if that is beyond its range.
+static uint64
+deadlinein(uint64 cycles)
+{
+  uint64 now = r_time();
+
+  if(cycles > ~0ULL - now)
+    return ~0ULL;
+  return now + cycles;
+}
+
+// Sleep until CLINT_MTIME reaches deadline.
+// Returns -1 if killed first.
+static int
+sleepdeadline(uint64 deadline)
+{
+  struct proc *p = myproc();
+
+  // nothing calls wakeup() on &deadline; only the timer
+  // (or kill()) wakes this process, so p->lock is the
+  // only lock it needs.
+  acquire(&p->lock);
+  while(r_time() < deadline){
+    if(p->killed){
+      release(&p->lock);
+      return -1;
+    }
+    sleepuntil(&deadline, &p->lock, deadline);
+  }
+  release(&p->lock);
+  return 0;
+}
+
 uint64
 sys_sleep(void)
 {
   int n;
-  uint ticks0;
 
   if(argint(0, &n) < 0)
     return -1;
-  acquire(&tickslock);
-  ticks0 = ticks;
-  while(ticks - ticks0 < n){
-    if(myproc()->killed){
-      release(&tickslock);
-      return -1;
-    }
-    sleep(&ticks, &tickslock);
-  }
-  release(&tickslock);
-  return 0;
+  if(n < 0)
+    n = 0;
+  return sleepdeadline(deadlinein((uint64)n * TICKINTERVAL));
+}
+
+uint64
+sys_nanosleep(void)
+{
+  uint64 ns;
+
+  if(argaddr(0, &ns) < 0)
+    return -1;
+  return sleepdeadline(deadlinein(ns / NSPERCYCLE + (ns % NSPERCYCLE != 0)));
 }
 
 uint64
@@ -83,15 +118,11 @@ sys_kill(void)
   return kill(pid);
 }
 
-// return how many clock tick interrupts have occurred
-// since start.
+// return how many scheduler tick intervals have elapsed
+// since start. harts may skip ticks (see timer.c), so this
+// counts CLINT_MTIME rather than tick interrupts.
 uint64
 sys_uptime(void)
 {
-  uint xticks;
-
-  acquire(&tickslock);
-  xticks = ticks;
-  release(&tickslock);
-  return xticks;
+  return r_time() / TICKINTERVAL;
 }
@@ -0,0 +1,12 @@
+// Per-system-call statistics, as returned by sysstat().
+// Both the kernel and user programs use this header file.
+
+#define NSYSHIST 24  // latency histogram buckets
+
+struct syscallstat {
+  char name[16];       // system call name, or "" if unused
+  uint64 count;        // invocations
+  uint64 errors;       // invocations that returned -1
+  uint64 cycles;       // CLINT_MTIME cycles spent, in total
+  uint64 hist[NSYSHIST]; // hist[i]: calls that took [2^i, 2^(i+1)) cycles
+};
@@ -0,0 +1,295 @@
+// One-shot timers.
+//
+// Each hart keeps a binary min-heap of pending timers, ordered
+// by deadline, and programs its CLINT_MTIMECMP for whichever
+// comes first: the earliest timer or its next scheduler tick.
+// timervec in kernelvec.S disarms MTIMECMP when it fires and
+// forwards a software interrupt to devintr(), which calls
+// timerintr() to run the expired timers and re-arm.
+//
+// A timer lives in the heap of the hart that called timerset(),
+// so its callback runs on that hart, in interrupt context,
+// without the heap lock held.
+//
+// While the profiler is on, each hart also keeps a deadline
+// for its next sample (see prof.c).
+//
+// The scheduler tick is only needed to time-slice between
+// processes. A hart that is idle, or whose process is the only
+// runnable one, stops its tick (cpu->nohz) and only wakes for
+// its own timers. Whoever makes a process runnable calls
+// timerkick(), which forces a timer interrupt on every such hart
+// so that it takes the new process into account.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "timer.h"
+#include "defs.h"
+
+#define NOTICK (~0ULL)
+
+struct {
+  struct spinlock lock;
+  struct timer *heap[NTIMER];
+  int n;
+  uint64 tick;    // deadline of this hart's next scheduler tick, or NOTICK
+  uint64 prof;    // deadline of this hart's next profiling sample, or NOTICK
+} timers[NCPU];
+
+static void
+heapput(int id, int i, struct timer *t)
+{
+  timers[id].heap[i] = t;
+  t->idx = i;
+}
+
+static void
+siftup(int id, int i)
+{
+  struct timer *t = timers[id].heap[i];
+
+  while(i > 0){
+    int parent = (i - 1) / 2;
+    if(timers[id].heap[parent]->deadline <= t->deadline)
+      break;
+    heapput(id, i, timers[id].heap[parent]);
+    i = parent;
+  }
+  heapput(id, i, t);
+}
+
+static void
+siftdown(int id, int i)
+{
+  struct timer *t = timers[id].heap[i];
+  int n = timers[id].n;
+
+  for(;;){
+    int c = 2*i + 1;
+    if(c >= n)
+      break;
+    if(c+1 < n && timers[id].heap[c+1]->deadline < timers[id].heap[c]->deadline)
+      c++;
+    if(t->deadline <= timers[id].heap[c]->deadline)
+      break;
+    heapput(id, i, timers[id].heap[c]);
+    i = c;
+  }
+  heapput(id, i, t);
+}
+
+// Take the timer at heap position i out of hart id's heap.
+static void
+heapremove(int id, int i)
+{
+  struct timer *t = timers[id].heap[i];
+  struct timer *last = timers[id].heap[--timers[id].n];
+
+  t->idx = -1;
+  if(last != t){
+    heapput(id, i, last);
+    siftdown(id, i);
+    siftup(id, last->idx);
+  }
+}
+
+// Program hart id's CLINT_MTIMECMP for its earliest event.
+// Caller must hold timers[id].lock.
+static void
+timerarm(int id)
+{
+  uint64 next = timers[id].tick;
+
+  if(timers[id].prof < next)
+    next = timers[id].prof;
+  if(timers[id].n > 0 && timers[id].heap[0]->deadline < next)
+    next = timers[id].heap[0]->deadline;
+  *(uint64*)CLINT_MTIMECMP(id) = next;
+}
+
+void
+timerinithart(void)
+{
+  int id = cpuid();
+
+  initlock(&timers[id].lock, "timer");
+  acquire(&timers[id].lock);
+  timers[id].n = 0;
+  timers[id].tick = r_time() + TICKINTERVAL;
+  timers[id].prof = NOTICK;
+  timerarm(id);
+  release(&timers[id].lock);
+}
+
+// Arrange for fn(arg) to be called once CLINT_MTIME reaches
+// deadline. t must stay allocated until it fires or until
+// timercancel(t) returns.
+void
+timerset(struct timer *t, uint64 deadline, void (*fn)(void*), void *arg)
+{
+  int id;
+
+  push_off();
+  id = cpuid();
+  acquire(&timers[id].lock);
+  if(timers[id].n >= NTIMER)
+    panic("timerset");
+  t->deadline = deadline;
+  t->fn = fn;
+  t->arg = arg;
+  t->cpu = id;
+  heapput(id, timers[id].n++, t);
+  siftup(id, t->idx);
+  if(t->idx == 0)
+    timerarm(id);
+  release(&timers[id].lock);
+  pop_off();
+}
+
+// Remove t if it has not fired yet.
+// Returns 1 if t was still pending, 0 if it had already fired.
+int
+timercancel(struct timer *t)
+{
+  int id = t->cpu;
+  int pending;
+
+  acquire(&timers[id].lock);
+  pending = t->idx >= 0;
+  if(pending)
+    heapremove(id, t->idx);
+  release(&timers[id].lock);
+  return pending;
+}
+
+// Does this hart still need its scheduler tick?
+// Not if it is idle, nor if no other process is waiting for
+// a CPU. Publishes cpu->nohz before looking at the process
+// table, so that a concurrent timerkick() cannot be missed.
+// Caller must hold the hart's timer lock.
+static int
+needtick(struct cpu *c)
+{
+  if(c->proc == 0)
+    return 0;
+  c->nohz = 1;
+  __sync_synchronize();
+  if(anyrunnable()){
+    c->nohz = 0;
+    return 1;
+  }
+  return 0;
+}
+
+// Called by devintr() for each forwarded machine timer interrupt.
+// Runs this hart's expired timers and re-arms MTIMECMP.
+// Returns 1 if the hart's scheduler tick has expired.
+int
+timerintr(void)
+{
+  int id = cpuid();
+  struct cpu *c = mycpu();
+  int tick = 0;
+  struct timer *t;
+  void (*fn)(void*);
+  void *arg;
+
+  acquire(&timers[id].lock);
+  while(timers[id].n > 0 && timers[id].heap[0]->deadline <= r_time()){
+    t = timers[id].heap[0];
+    fn = t->fn;
+    arg = t->arg;
+    heapremove(id, 0);
+
+    // t may be freed by its owner once it is off the heap,
+    // and fn may acquire locks that are held across timerset().
+    release(&timers[id].lock);
+    fn(arg);
+    acquire(&timers[id].lock);
+  }
+  if(timers[id].tick <= r_time()){
+    if(needtick(c)){
+      tick = 1;
+      timers[id].tick = r_time() + TICKINTERVAL;
+    } else {
+      timers[id].tick = NOTICK;
+    }
+  }
+  if(profperiod == 0){
+    timers[id].prof = NOTICK;
+  } else if(timers[id].prof == NOTICK){
+    timers[id].prof = r_time() + profperiod;
+  } else if(timers[id].prof <= r_time()){
+    // the trap handler takes the sample; see profintr().
+    c->profpending = 1;
+    timers[id].prof = r_time() + profperiod;
+  }
+  timerarm(id);
+  release(&timers[id].lock);
+  return tick;
+}
+
+// Called by the scheduler, with interrupts off, when it finds
+// nothing to run: stop this hart's tick before it waits.
+void
+timeridle(void)
+{
+  int id = cpuid();
+
+  acquire(&timers[id].lock);
+  mycpu()->nohz = 1;
+  timers[id].tick = NOTICK;
+  timerarm(id);
+  release(&timers[id].lock);
+}
+
+// Called by the scheduler before it runs a process:
+// restart this hart's tick if it was stopped.
+void
+timerresume(void)
+{
+  int id = cpuid();
+
+  acquire(&timers[id].lock);
+  mycpu()->nohz = 0;
+  if(timers[id].tick == NOTICK){
+    timers[id].tick = r_time() + TICKINTERVAL;
+    timerarm(id);
+  }
+  release(&timers[id].lock);
+}
+
+// Make hart id take a timer interrupt now, whether or not
+// it is due; used to push it through a quiescent state (rcu.c).
+void
+timerpoke(int id)
+{
+  acquire(&timers[id].lock);
+  *(uint64*)CLINT_MTIMECMP(id) = 0;
+  release(&timers[id].lock);
+}
+
+// A process has become runnable, or must notice that it was
+// killed. Make every hart that has stopped its tick take a
+// timer interrupt now; timerintr() will restart the tick and
+// yield if there is something else to run.
+void
+timerkick(void)
+{
+  __sync_synchronize();
+  for(int i = 0; i < NCPU; i++){
+    if(cpus[i].nohz == 0)
+      continue;
+    acquire(&timers[i].lock);
+    if(cpus[i].nohz){
+      cpus[i].nohz = 0;
+      timers[i].tick = 0;
+      *(uint64*)CLINT_MTIMECMP(i) = 0;
+    }
+    release(&timers[i].lock);
+  }
+}
@@ -0,0 +1,9 @@
+// One-shot kernel timer.
+struct timer {
+  uint64 deadline;      // CLINT_MTIME value at which to fire
+  void (*fn)(void*);    // called from the timer interrupt
+  void *arg;
+
+  int cpu;              // hart whose heap holds this timer
+  int idx;              // position in that heap, or -1 if not pending
+};
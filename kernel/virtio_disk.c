@@ -5,6 +5,9 @@
 //
 // qemu ... -drive file=fs.img,if=none,format=raw,id=x0 -device virtio-blk-device,drive=x0,bus=virtio-mmio-bus.0
 //
+// a second disk on virtio-mmio-bus.1 (VIRTIO1) is also driven;
+// with two disks, the root device is a stripe over both (stripe.c).
+//
 
 #include "types.h"
 #include "riscv.h"
@@ -15,10 +18,14 @@
 #include "sleeplock.h"
 #include "fs.h"
 #include "buf.h"
+#include "iosched.h"
+#include "bdev.h"
 #include "virtio.h"
+#include "ktrace.h"
+
+// the address of virtio mmio register r of disk dk.
+#define R(dk, r) ((volatile uint32 *)((dk)->base + (r)))
 
-// the address of virtio mmio register r.
-#define R(r) ((volatile uint32 *)(VIRTIO0 + (r)))
 
 static struct disk {
   // the virtio driver and device mostly communicate through a set of
@@ -55,234 +62,339 @@ static struct disk {
 
   // our own book-keeping.
   char free[NUM];  // is a descriptor free?
+  uint16 freelist[NUM]; // stack of the free descriptors
+  int nfree;
   uint16 used_idx; // we've looked this far in used[2..NUM].
 
   // track info about in-flight operations,
   // for use when completion interrupt arrives.
   // indexed by first descriptor index of chain.
   struct {
-    struct buf *b;
+    struct ioreq *r;
     char status;
   } info[NUM];
 
+  int npolling;    // harts polling the used ring
+
   // disk command headers.
   // one-for-one with descriptors, for convenience.
   struct virtio_blk_req ops[NUM];
+
+  // with VIRTIO_RING_F_INDIRECT_DESC, each request's chain is
+  // in the table belonging to its ring descriptor.
+  int indirect;
+  struct virtq_desc itable[NUM][MAXSEG+2];
   
   struct spinlock vdisk_lock;
-  
-} __attribute__ ((aligned (PGSIZE))) disk;
+  struct spinlock flushlock; // for virtio_disk_flush() to sleep on
 
-void
-virtio_disk_init(void)
+  uint64 base;     // mmio registers
+  struct bdev bdev;
+  
+} __attribute__ ((aligned (PGSIZE))) disks[NVIRTIO];
+
+// a cache flush, and whether it is done.
+struct flushreq {
+  struct ioreq r;
+  struct disk *dk;
+  int done;
+};
+
+static uint64 mmiobase[NVIRTIO] = { VIRTIO0, VIRTIO1 };
+
+static int virtio_disk_submit(struct bdev*, struct ioreq*);
+static uint virtio_disk_capacity(struct bdev*);
+static void virtio_disk_pollstart(struct bdev*);
+static void virtio_disk_poll(struct bdev*);
+static void virtio_disk_pollend(struct bdev*);
+static void virtio_disk_flush(struct bdev*);
+
+// Set up virtio disk unit, if there is one there.
+// Returns 0 if there is not.
+static int
+probe(int unit)
 {
+  struct disk *dk = &disks[unit];
   uint32 status = 0;
 
-  initlock(&disk.vdisk_lock, "virtio_disk");
-
-  if(*R(VIRTIO_MMIO_MAGIC_VALUE) != 0x74726976 ||
-     *R(VIRTIO_MMIO_VERSION) != 1 ||
-     *R(VIRTIO_MMIO_DEVICE_ID) != 2 ||
-     *R(VIRTIO_MMIO_VENDOR_ID) != 0x554d4551){
-    panic("could not find virtio disk");
+  dk->base = mmiobase[unit];
+  if(*R(dk, VIRTIO_MMIO_MAGIC_VALUE) != 0x74726976 ||
+     *R(dk, VIRTIO_MMIO_VERSION) != 1 ||
+     *R(dk, VIRTIO_MMIO_DEVICE_ID) != 2 ||
+     *R(dk, VIRTIO_MMIO_VENDOR_ID) != 0x554d4551){
+    return 0;
   }
+
+  initlock(&dk->vdisk_lock, "virtio_disk");
+  initlock(&dk->flushlock, "virtio_flush");
   
   status |= VIRTIO_CONFIG_S_ACKNOWLEDGE;
-  *R(VIRTIO_MMIO_STATUS) = status;
+  *R(dk, VIRTIO_MMIO_STATUS) = status;
 
   status |= VIRTIO_CONFIG_S_DRIVER;
-  *R(VIRTIO_MMIO_STATUS) = status;
+  *R(dk, VIRTIO_MMIO_STATUS) = status;
 
   // negotiate features
-  uint64 features = *R(VIRTIO_MMIO_DEVICE_FEATURES);
+  uint64 features = *R(dk, VIRTIO_MMIO_DEVICE_FEATURES);
   features &= ~(1 << VIRTIO_BLK_F_RO);
   features &= ~(1 << VIRTIO_BLK_F_SCSI);
   features &= ~(1 << VIRTIO_BLK_F_CONFIG_WCE);
   features &= ~(1 << VIRTIO_BLK_F_MQ);
   features &= ~(1 << VIRTIO_F_ANY_LAYOUT);
   features &= ~(1 << VIRTIO_RING_F_EVENT_IDX);
-  features &= ~(1 << VIRTIO_RING_F_INDIRECT_DESC);
-  *R(VIRTIO_MMIO_DRIVER_FEATURES) = features;
+  *R(dk, VIRTIO_MMIO_DRIVER_FEATURES) = features;
+  dk->indirect = (features >> VIRTIO_RING_F_INDIRECT_DESC) & 1;
+  // without VIRTIO_BLK_F_FLUSH, the device has no write cache
+  // to flush: a finished write is durable.
+  if(features & (1 << VIRTIO_BLK_F_FLUSH))
+    dk->bdev.flush = virtio_disk_flush;
 
   // tell device that feature negotiation is complete.
   status |= VIRTIO_CONFIG_S_FEATURES_OK;
-  *R(VIRTIO_MMIO_STATUS) = status;
+  *R(dk, VIRTIO_MMIO_STATUS) = status;
 
   // tell device we're completely ready.
   status |= VIRTIO_CONFIG_S_DRIVER_OK;
-  *R(VIRTIO_MMIO_STATUS) = status;
+  *R(dk, VIRTIO_MMIO_STATUS) = status;
 
-  *R(VIRTIO_MMIO_GUEST_PAGE_SIZE) = PGSIZE;
+  *R(dk, VIRTIO_MMIO_GUEST_PAGE_SIZE) = PGSIZE;
 
   // initialize queue 0.
-  *R(VIRTIO_MMIO_QUEUE_SEL) = 0;
-  uint32 max = *R(VIRTIO_MMIO_QUEUE_NUM_MAX);
+  *R(dk, VIRTIO_MMIO_QUEUE_SEL) = 0;
+  uint32 max = *R(dk, VIRTIO_MMIO_QUEUE_NUM_MAX);
   if(max == 0)
     panic("virtio disk has no queue 0");
   if(max < NUM)
     panic("virtio disk max queue too short");
-  *R(VIRTIO_MMIO_QUEUE_NUM) = NUM;
-  memset(disk.pages, 0, sizeof(disk.pages));
-  *R(VIRTIO_MMIO_QUEUE_PFN) = ((uint64)disk.pages) >> PGSHIFT;
+  *R(dk, VIRTIO_MMIO_QUEUE_NUM) = NUM;
+  memset(dk->pages, 0, sizeof(dk->pages));
+  *R(dk, VIRTIO_MMIO_QUEUE_PFN) = ((uint64)dk->pages) >> PGSHIFT;
 
   // desc = pages -- num * virtq_desc
   // avail = pages + 0x40 -- 2 * uint16, then num * uint16
   // used = pages + 4096 -- 2 * uint16, then num * vRingUsedElem
 
-  disk.desc = (struct virtq_desc *) disk.pages;
-  disk.avail = (struct virtq_avail *)(disk.pages + NUM*sizeof(struct virtq_desc));
-  disk.used = (struct virtq_used *) (disk.pages + PGSIZE);
+  dk->desc = (struct virtq_desc *) dk->pages;
+  dk->avail = (struct virtq_avail *)(dk->pages + NUM*sizeof(struct virtq_desc));
+  dk->used = (struct virtq_used *) (dk->pages + PGSIZE);
 
   // all NUM descriptors start out unused.
-  for(int i = 0; i < NUM; i++)
-    disk.free[i] = 1;
+  for(int i = 0; i < NUM; i++){
+    dk->free[i] = 1;
+    dk->freelist[i] = i;
+  }
+  dk->nfree = NUM;
+
+  dk->bdev.name = "virtio";
+  dk->bdev.priv = dk;
+  dk->bdev.submit = virtio_disk_submit;
+  dk->bdev.capacity = virtio_disk_capacity;
+  dk->bdev.pollstart = virtio_disk_pollstart;
+  dk->bdev.poll = virtio_disk_poll;
+  dk->bdev.pollend = virtio_disk_pollend;
+  return 1;
+}
 
-  // plic.c and trap.c arrange for interrupts from VIRTIO0_IRQ.
+void
+virtio_disk_init(void)
+{
+  struct bdev *member[NVIRTIO];
+  int n;
+
+  for(n = 0; n < NVIRTIO && probe(n); n++)
+    member[n] = &disks[n].bdev;
+  if(n == 0)
+    panic("could not find virtio disk");
+
+  // one disk is the root disk; more are striped into one.
+  if(n == 1)
+    bdevregister(ROOTDEV, member[0]);
+  else
+    stripeinit(ROOTDEV, member, n);
+
+  // plic.c and trap.c arrange for interrupts from VIRTIO0_IRQ
+  // and VIRTIO1_IRQ.
+}
+
+// the capacity field of the configuration space counts
+// 512-byte sectors.
+static uint
+virtio_disk_capacity(struct bdev *bd)
+{
+  struct disk *dk = bd->priv;
+  uint64 lo = *R(dk, VIRTIO_MMIO_CONFIG + VIRTIO_BLK_CONFIG_CAPACITY);
+  uint64 hi = *R(dk, VIRTIO_MMIO_CONFIG + VIRTIO_BLK_CONFIG_CAPACITY + 4);
+
+  return ((hi << 32) | lo) / (BSIZE / 512);
 }
 
-// find a free descriptor, mark it non-free, return its index.
+// take a free descriptor, mark it non-free, return its index.
 static int
-alloc_desc()
+alloc_desc(struct disk *dk)
 {
-  for(int i = 0; i < NUM; i++){
-    if(disk.free[i]){
-      disk.free[i] = 0;
-      return i;
-    }
-  }
-  return -1;
+  int i;
+
+  if(dk->nfree == 0)
+    return -1;
+  i = dk->freelist[--dk->nfree];
+  dk->free[i] = 0;
+  return i;
 }
 
 // mark a descriptor as free.
 static void
-free_desc(int i)
+free_desc(struct disk *dk, int i)
 {
   if(i >= NUM)
     panic("free_desc 1");
-  if(disk.free[i])
+  if(dk->free[i])
     panic("free_desc 2");
-  disk.desc[i].addr = 0;
-  disk.desc[i].len = 0;
-  disk.desc[i].flags = 0;
-  disk.desc[i].next = 0;
-  disk.free[i] = 1;
-  wakeup(&disk.free[0]);
+  dk->desc[i].addr = 0;
+  dk->desc[i].len = 0;
+  dk->desc[i].flags = 0;
+  dk->desc[i].next = 0;
+  dk->free[i] = 1;
+  dk->freelist[dk->nfree++] = i;
 }
 
 // free a chain of descriptors.
 static void
-free_chain(int i)
+free_chain(struct disk *dk, int i)
 {
   while(1){
-    int flag = disk.desc[i].flags;
-    int nxt = disk.desc[i].next;
-    free_desc(i);
+    int flag = dk->desc[i].flags;
+    int nxt = dk->desc[i].next;
+    free_desc(dk, i);
     if(flag & VRING_DESC_F_NEXT)
       i = nxt;
     else
       break;
   }
+  wakeup(&dk->free[0]);
 }
 
-// allocate three descriptors (they need not be contiguous).
-// disk transfers always use three descriptors.
+// allocate n descriptors (they need not be contiguous),
+// or none if there are not that many free.
 static int
-alloc3_desc(int *idx)
+alloc_descs(struct disk *dk, int *idx, int n)
 {
-  for(int i = 0; i < 3; i++){
-    idx[i] = alloc_desc();
-    if(idx[i] < 0){
-      for(int j = 0; j < i; j++)
-        free_desc(idx[j]);
-      return -1;
-    }
-  }
+  if(dk->nfree < n)
+    return -1;
+  for(int i = 0; i < n; i++)
+    idx[i] = alloc_desc(dk);
   return 0;
 }
 
-void
-virtio_disk_rw(struct buf *b, int write)
+// Send request r to the device, without waiting for it; when
+// it is done, virtio_disk_intr() passes it to r->done().
+// Returns -1 if there are not enough free descriptors.
+static int
+virtio_disk_submit(struct bdev *bd, struct ioreq *r)
 {
-  uint64 sector = b->blockno * (BSIZE / 512);
+  struct disk *dk = bd->priv;
+  uint64 sector = r->blockno * (BSIZE / 512);
+  struct virtq_desc *d;
+  struct buf *b;
+  int idx[MAXSEG+2];
+  int i, head, nd;
 
-  acquire(&disk.vdisk_lock);
+  if(r->flush ? r->n != 0 : r->n < 1 || r->n > MAXSEG)
+    panic("virtio_disk_submit");
 
-  // the spec's Section 5.2 says that legacy block operations use
-  // three descriptors: one for type/reserved/sector, one for the
-  // data, one for a 1-byte status result.
+  acquire(&dk->vdisk_lock);
 
-  // allocate the three descriptors.
-  int idx[3];
-  while(1){
-    if(alloc3_desc(idx) == 0) {
-      break;
-    }
-    sleep(&disk.free[0], &disk.vdisk_lock);
+  // the spec's Section 5.2 says that legacy block operations use
+  // one descriptor for type/reserved/sector, then the data, then
+  // one for a 1-byte status result. we give each buffer its own
+  // data descriptor. with indirect descriptors, the chain lives
+  // in a table of our own, and takes one descriptor of the ring.
+  nd = dk->indirect ? 1 : r->n + 2;
+
+  // allocate the descriptors.
+  if(alloc_descs(dk, idx, nd) < 0){
+    release(&dk->vdisk_lock);
+    return -1;
+  }
+  head = idx[0];
+  if(dk->indirect){
+    d = dk->itable[head];
+    for(i = 0; i < r->n + 2; i++)
+      idx[i] = i;
+  } else {
+    d = dk->desc;
   }
 
-  // format the three descriptors.
+  // format the descriptors.
   // qemu's virtio-blk.c reads them.
 
-  struct virtio_blk_req *buf0 = &disk.ops[idx[0]];
+  struct virtio_blk_req *buf0 = &dk->ops[head];
 
-  if(write)
+  if(r->flush)
+    buf0->type = VIRTIO_BLK_T_FLUSH; // flush the device's cache
+  else if(r->write)
     buf0->type = VIRTIO_BLK_T_OUT; // write the disk
   else
     buf0->type = VIRTIO_BLK_T_IN; // read the disk
   buf0->reserved = 0;
   buf0->sector = sector;
 
-  disk.desc[idx[0]].addr = (uint64) buf0;
-  disk.desc[idx[0]].len = sizeof(struct virtio_blk_req);
-  disk.desc[idx[0]].flags = VRING_DESC_F_NEXT;
-  disk.desc[idx[0]].next = idx[1];
+  d[idx[0]].addr = (uint64) buf0;
+  d[idx[0]].len = sizeof(struct virtio_blk_req);
+  d[idx[0]].flags = VRING_DESC_F_NEXT;
+  d[idx[0]].next = idx[1];
 
-  disk.desc[idx[1]].addr = (uint64) b->data;
-  disk.desc[idx[1]].len = BSIZE;
-  if(write)
-    disk.desc[idx[1]].flags = 0; // device reads b->data
-  else
-    disk.desc[idx[1]].flags = VRING_DESC_F_WRITE; // device writes b->data
-  disk.desc[idx[1]].flags |= VRING_DESC_F_NEXT;
-  disk.desc[idx[1]].next = idx[2];
+  for(b = r->head, i = 1; b; b = b->qnext, i++){
+    d[idx[i]].addr = (uint64) b->data;
+    d[idx[i]].len = BSIZE;
+    if(r->write)
+      d[idx[i]].flags = 0; // device reads b->data
+    else
+      d[idx[i]].flags = VRING_DESC_F_WRITE; // device writes b->data
+    d[idx[i]].flags |= VRING_DESC_F_NEXT;
+    d[idx[i]].next = idx[i+1];
+  }
 
-  disk.info[idx[0]].status = 0xff; // device writes 0 on success
-  disk.desc[idx[2]].addr = (uint64) &disk.info[idx[0]].status;
-  disk.desc[idx[2]].len = 1;
-  disk.desc[idx[2]].flags = VRING_DESC_F_WRITE; // device writes the status
-  disk.desc[idx[2]].next = 0;
+  dk->info[head].status = 0xff; // device writes 0 on success
+  d[idx[i]].addr = (uint64) &dk->info[head].status;
+  d[idx[i]].len = 1;
+  d[idx[i]].flags = VRING_DESC_F_WRITE; // device writes the status
+  d[idx[i]].next = 0;
+
+  if(dk->indirect){
+    dk->desc[head].addr = (uint64) d;
+    dk->desc[head].len = (r->n + 2) * sizeof(struct virtq_desc);
+    dk->desc[head].flags = VRING_DESC_F_INDIRECT;
+    dk->desc[head].next = 0;
+  }
 
-  // record struct buf for virtio_disk_intr().
-  b->disk = 1;
-  disk.info[idx[0]].b = b;
+  // record the request for virtio_disk_intr().
+  dk->info[head].r = r;
+  KTRACE(KT_DISKSUBMIT, r->blockno, r->write);
 
   // tell the device the first index in our chain of descriptors.
-  disk.avail->ring[disk.avail->idx % NUM] = idx[0];
+  dk->avail->ring[dk->avail->idx % NUM] = head;
 
   __sync_synchronize();
 
   // tell the device another avail ring entry is available.
-  disk.avail->idx += 1; // not % NUM ...
+  dk->avail->idx += 1; // not % NUM ...
 
   __sync_synchronize();
 
-  *R(VIRTIO_MMIO_QUEUE_NOTIFY) = 0; // value is queue number
+  *R(dk, VIRTIO_MMIO_QUEUE_NOTIFY) = 0; // value is queue number
 
-  // Wait for virtio_disk_intr() to say request has finished.
-  while(b->disk == 1) {
-    sleep(b, &disk.vdisk_lock);
-  }
-
-  disk.info[idx[0]].b = 0;
-  free_chain(idx[0]);
-
-  release(&disk.vdisk_lock);
+  release(&dk->vdisk_lock);
+  return 0;
 }
 
-void
-virtio_disk_intr()
+// Take finished requests off dk's used ring, and hand them to
+// whoever submitted them. If ack, acknowledge the device's interrupt.
+static void
+reap(struct disk *dk, int ack)
 {
-  acquire(&disk.vdisk_lock);
+  struct ioreq *r, *done = 0;
+
+  acquire(&dk->vdisk_lock);
 
   // the device won't raise another interrupt until we tell it
   // we've seen this interrupt, which the following line does.
@@ -290,26 +402,125 @@ virtio_disk_intr()
   // the "used" ring, in which case we may process the new
   // completion entries in this interrupt, and have nothing to do
   // in the next interrupt, which is harmless.
-  *R(VIRTIO_MMIO_INTERRUPT_ACK) = *R(VIRTIO_MMIO_INTERRUPT_STATUS) & 0x3;
+  if(ack)
+    *R(dk, VIRTIO_MMIO_INTERRUPT_ACK) = *R(dk, VIRTIO_MMIO_INTERRUPT_STATUS) & 0x3;
 
   __sync_synchronize();
 
-  // the device increments disk.used->idx when it
+  // the device increments dk->used->idx when it
   // adds an entry to the used ring.
 
-  while(disk.used_idx != disk.used->idx){
+  while(dk->used_idx != dk->used->idx){
     __sync_synchronize();
-    int id = disk.used->ring[disk.used_idx % NUM].id;
+    int id = dk->used->ring[dk->used_idx % NUM].id;
 
-    if(disk.info[id].status != 0)
+    if(dk->info[id].status != 0)
       panic("virtio_disk_intr status");
 
-    struct buf *b = disk.info[id].b;
-    b->disk = 0;   // disk is done with buf
-    wakeup(b);
+    r = dk->info[id].r;
+    KTRACE(KT_DISKDONE, r->blockno, 0);
+    dk->info[id].r = 0;
+    free_chain(dk, id);
 
-    disk.used_idx += 1;
+    // hand it back once we are done with the ring.
+    r->next = done;
+    done = r;
+
+    dk->used_idx += 1;
   }
 
-  release(&disk.vdisk_lock);
+  release(&dk->vdisk_lock);
+
+  if(done){
+    // a flush may be waiting for descriptors.
+    acquire(&dk->flushlock);
+    wakeup(dk);
+    release(&dk->flushlock);
+  }
+
+  while((r = done) != 0){
+    done = r->next;
+    r->done(r);
+  }
+}
+
+void
+virtio_disk_intr(int unit)
+{
+  reap(&disks[unit], 1);
+}
+
+// Polling. While some hart is polling, the device is asked not
+// to interrupt, since the pollers reap every completion. The
+// request is only a hint; a stray interrupt is harmless.
+
+static void
+virtio_disk_pollstart(struct bdev *bd)
+{
+  struct disk *dk = bd->priv;
+
+  acquire(&dk->vdisk_lock);
+  if(dk->npolling++ == 0)
+    dk->avail->flags |= VRING_AVAIL_F_NO_INTERRUPT;
+  release(&dk->vdisk_lock);
+}
+
+// Reap whatever has finished, without waiting.
+static void
+virtio_disk_poll(struct bdev *bd)
+{
+  struct disk *dk = bd->priv;
+
+  if(dk->used_idx != *(volatile uint16*)&dk->used->idx)
+    reap(dk, 0);
+}
+
+static void
+virtio_disk_pollend(struct bdev *bd)
+{
+  struct disk *dk = bd->priv;
+
+  acquire(&dk->vdisk_lock);
+  if(--dk->npolling == 0)
+    dk->avail->flags &= ~VRING_AVAIL_F_NO_INTERRUPT;
+  release(&dk->vdisk_lock);
+  __sync_synchronize();
+
+  // a request may have finished after the last poll, while the
+  // device was told not to interrupt.
+  reap(dk, 0);
+}
+
+static void
+flushdone(struct ioreq *r)
+{
+  struct flushreq *f = (struct flushreq*)r;
+
+  acquire(&f->dk->flushlock);
+  f->done = 1;
+  wakeup(f);
+  release(&f->dk->flushlock);
+}
+
+// Make every write the device has finished durable: send a
+// VIRTIO_BLK_T_FLUSH and wait for it. Called without locks.
+static void
+virtio_disk_flush(struct bdev *bd)
+{
+  struct disk *dk = bd->priv;
+  struct flushreq f;
+
+  memset(&f, 0, sizeof(f));
+  f.r.dev = ROOTDEV;
+  f.r.flush = 1;
+  f.r.write = 1;
+  f.r.done = flushdone;
+  f.dk = dk;
+
+  acquire(&dk->flushlock);
+  while(virtio_disk_submit(bd, &f.r) < 0)
+    sleep(dk, &dk->flushlock);  // ring full
+  while(!f.done)
+    sleep(&f, &dk->flushlock);
+  release(&dk->flushlock);
 }
@@ -19,14 +19,22 @@
 
 // Disk layout:
 // [ boot block | sb block | log | inode blocks | free bit map | data blocks ]
+//
+// With -s, the image is striped over two files the way the kernel
+// stripes its root over two disks (kernel/stripe.c): STRIPESZ
+// blocks on the first, the next STRIPESZ on the second, and so on.
+//
+// With -l n, the log has room for two transactions of n blocks,
+// instead of LOGSIZE; the kernel uses up to LOGMAX of them.
 
 int nbitmap = FSSIZE/(BSIZE*8) + 1;
 int ninodeblocks = NINODES / IPB + 1;
-int nlog = LOGSIZE;
+int nlog;     // header, and room for two transactions
 int nmeta;    // Number of meta blocks (boot, sb, nlog, inode, bitmap)
 int nblocks;  // Number of data blocks
 
-int fsfd;
+int fsfd[2];
+int nfsfd = 1;  // 2 if striped
 struct superblock sb;
 char zeroes[BSIZE];
 uint freeinode = 1;
@@ -41,6 +49,7 @@ void rsect(uint sec, void *buf);
 uint ialloc(ushort type);
 void iappend(uint inum, void *p, int n);
 void die(const char *);
+int seeksect(uint);
 
 // convert to intel byte order
 ushort
@@ -68,7 +77,7 @@ xint(uint x)
 int
 main(int argc, char *argv[])
 {
-  int i, cc, fd;
+  int i, cc, fd, first, logsize = LOGSIZE;
   uint rootino, inum, off;
   struct dirent de;
   char buf[BSIZE];
@@ -77,17 +86,30 @@ main(int argc, char *argv[])
 
   static_assert(sizeof(int) == 4, "Integers must be 4 bytes!");
 
-  if(argc < 2){
-    fprintf(stderr, "Usage: mkfs fs.img files...\n");
+  for(first = 1; first < argc && argv[first][0] == '-'; first++){
+    if(strcmp(argv[first], "-s") == 0)
+      nfsfd = 2;
+    else if(strcmp(argv[first], "-l") == 0 && first+1 < argc)
+      logsize = atoi(argv[++first]);
+    else
+      break;
+  }
+  if(argc < first + nfsfd || logsize < MAXOPBLOCKS || logsize > LOGMAX){
+    fprintf(stderr, "Usage: mkfs [-l logsize] fs.img files...\n");
+    fprintf(stderr, "       mkfs [-l logsize] -s fs0.img fs1.img files...\n");
+    fprintf(stderr, "logsize is %d to %d blocks\n", MAXOPBLOCKS, LOGMAX);
     exit(1);
   }
+  nlog = 1 + 2*logsize;
 
   assert((BSIZE % sizeof(struct dinode)) == 0);
   assert((BSIZE % sizeof(struct dirent)) == 0);
 
-  fsfd = open(argv[1], O_RDWR|O_CREAT|O_TRUNC, 0666);
-  if(fsfd < 0)
-    die(argv[1]);
+  for(i = 0; i < nfsfd; i++){
+    fsfd[i] = open(argv[first+i], O_RDWR|O_CREAT|O_TRUNC, 0666);
+    if(fsfd[i] < 0)
+      die(argv[first+i]);
+  }
 
   // 1 fs block = 1 disk sector
   nmeta = 2 + nlog + ninodeblocks + nbitmap;
@@ -110,6 +132,15 @@ main(int argc, char *argv[])
   for(i = 0; i < FSSIZE; i++)
     wsect(i, zeroes);
 
+  // make the stripes equally long, so that the kernel
+  // sees all of the image.
+  if(nfsfd == 2){
+    off = (FSSIZE + 2*STRIPESZ - 1) / (2*STRIPESZ) * STRIPESZ * BSIZE;
+    for(i = 0; i < nfsfd; i++)
+      if(ftruncate(fsfd[i], off) < 0)
+        die("ftruncate");
+  }
+
   memset(buf, 0, sizeof(buf));
   memmove(buf, &sb, sizeof(sb));
   wsect(1, buf);
@@ -127,7 +158,7 @@ main(int argc, char *argv[])
   strcpy(de.name, "..");
   iappend(rootino, &de, sizeof(de));
 
-  for(i = 2; i < argc; i++){
+  for(i = first + nfsfd; i < argc; i++){
     // get rid of "user/"
     char *shortname;
     if(strncmp(argv[i], "user/", 5) == 0)
@@ -172,12 +203,26 @@ main(int argc, char *argv[])
   exit(0);
 }
 
+// seek to sector sec, and return the file it is in.
+int
+seeksect(uint sec)
+{
+  int fd = fsfd[0];
+  off_t off = (off_t)sec * BSIZE;
+
+  if(nfsfd == 2){
+    fd = fsfd[(sec / STRIPESZ) % 2];
+    off = ((off_t)sec / STRIPESZ / 2 * STRIPESZ + sec % STRIPESZ) * BSIZE;
+  }
+  if(lseek(fd, off, 0) != off)
+    die("lseek");
+  return fd;
+}
+
 void
 wsect(uint sec, void *buf)
 {
-  if(lseek(fsfd, sec * BSIZE, 0) != sec * BSIZE)
-    die("lseek");
-  if(write(fsfd, buf, BSIZE) != BSIZE)
+  if(write(seeksect(sec), buf, BSIZE) != BSIZE)
     die("write");
 }
 
@@ -211,9 +256,7 @@ rinode(uint inum, struct dinode *ip)
 void
 rsect(uint sec, void *buf)
 {
-  if(lseek(fsfd, sec * BSIZE, 0) != sec * BSIZE)
-    die("lseek");
-  if(read(fsfd, buf, BSIZE) != BSIZE)
+  if(read(seeksect(sec), buf, BSIZE) != BSIZE)
     die("read");
 }
 
@@ -0,0 +1,126 @@
+#!/usr/bin/env python3
+
+"""Symbolize the samples printed by xv6's prof command.
+
+Usage: profreport.py [-n N] [-g] LOG
+
+LOG is a console capture (e.g. xv6.out) containing lines of the form
+  prof HART PID NAME k|u PC0 PC1 ...
+Kernel addresses are resolved against kernel/kernel.sym and user
+addresses against user/NAME.sym, both produced by the Makefile.
+Prints a flat profile (samples whose pc0 falls in each function) and,
+with -g, a call graph: the inclusive count of each function and its
+hottest callers.
+"""
+
+from __future__ import print_function
+
+import bisect, collections, os, re, sys
+from optparse import OptionParser
+
+SAMPLE_RE = re.compile(r'^prof (\d+) (\d+) (\S+) ([ku])((?: 0x[0-9a-fA-F]+)+)\s*$')
+
+class SymbolTable(object):
+    def __init__(self, path):
+        self.addrs = []
+        self.names = []
+        if not os.path.exists(path):
+            return
+        syms = []
+        with open(path) as f:
+            for line in f:
+                parts = line.split()
+                if len(parts) != 2:
+                    continue
+                addr, name = int(parts[0], 16), parts[1]
+                # skip file names and section markers.
+                if addr == 0 or name.startswith('.') or name.endswith(('.c', '.S', '.o')):
+                    continue
+                syms.append((addr, name))
+        syms.sort()
+        self.addrs = [a for a, _ in syms]
+        self.names = [n for _, n in syms]
+
+    def lookup(self, addr):
+        i = bisect.bisect_right(self.addrs, addr) - 1
+        if i < 0:
+            return '0x%x' % addr
+        return self.names[i]
+
+class Symbolizer(object):
+    def __init__(self, root):
+        self.root = root
+        self.kernel = SymbolTable(os.path.join(root, 'kernel', 'kernel.sym'))
+        self.user = {}
+
+    def lookup(self, name, user, pc, first):
+        # return addresses point after the call; look up the
+        # call instruction itself so tail positions resolve right.
+        if not first:
+            pc -= 4
+        if not user:
+            return self.kernel.lookup(pc)
+        if name not in self.user:
+            self.user[name] = SymbolTable(os.path.join(self.root, 'user', name + '.sym'))
+        return '%s:%s' % (name, self.user[name].lookup(pc))
+
+def parse(path):
+    with open(path, errors='replace') as f:
+        for line in f:
+            m = SAMPLE_RE.match(line.strip())
+            if not m:
+                continue
+            pcs = [int(x, 16) for x in m.group(5).split()]
+            yield int(m.group(1)), int(m.group(2)), m.group(3), m.group(4) == 'u', pcs
+
+def main():
+    parser = OptionParser(usage='usage: %prog [-n N] [-g] LOG')
+    parser.add_option('-n', type='int', default=25, help='rows to print')
+    parser.add_option('-g', action='store_true', help='print a call graph')
+    parser.add_option('--root', default=os.path.dirname(os.path.abspath(__file__)),
+                      help='xv6 source tree holding kernel/ and user/')
+    opts, args = parser.parse_args()
+    if len(args) != 1:
+        parser.error('need a console log')
+
+    syms = Symbolizer(opts.root)
+    flat = collections.Counter()
+    inclusive = collections.Counter()
+    callers = collections.defaultdict(collections.Counter)
+    harts = collections.Counter()
+    total = 0
+
+    for hart, pid, name, user, pcs in parse(args[0]):
+        frames = [syms.lookup(name, user, pc, i == 0) for i, pc in enumerate(pcs)]
+        if not user and pid == 0:
+            frames[0] = '%s (idle)' % frames[0]
+        total += 1
+        harts[hart] += 1
+        flat[frames[0]] += 1
+        for f in set(frames):
+            inclusive[f] += 1
+        for callee, caller in zip(frames, frames[1:]):
+            callers[callee][caller] += 1
+
+    if total == 0:
+        print('no samples found in %s' % args[0])
+        return 1
+
+    print('%d samples on %d harts' % (total, len(harts)))
+    print()
+    print('Flat profile:')
+    print('%8s %6s  %s' % ('samples', '%', 'function'))
+    for f, n in flat.most_common(opts.n):
+        print('%8d %6.2f  %s' % (n, 100.0 * n / total, f))
+
+    if opts.g:
+        print()
+        print('Call graph (inclusive samples, top callers):')
+        for f, n in inclusive.most_common(opts.n):
+            print('%8d %6.2f  %s' % (n, 100.0 * n / total, f))
+            for caller, m in callers[f].most_common(3):
+                print('%8s %6s      <- %s (%d)' % ('', '', caller, m))
+    return 0
+
+if __name__ == '__main__':
+    sys.exit(main())
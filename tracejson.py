@@ -0,0 +1,117 @@
+#!/usr/bin/env python3
+
+"""Convert xv6 kernel event traces to Chrome trace JSON.
+
+Usage: tracejson.py LOG [OUT]
+
+LOG is a console capture (e.g. xv6.out) containing the lines
+printed by the ktrace command:
+  ktrace TIME HART PID TYPE ARG0 ARG1
+OUT (default: stdout) can be loaded into chrome://tracing or
+https://ui.perfetto.dev. Each hart gets a track showing which
+process it ran, with sleeps, wakeups and page faults marked on
+it; disk requests and log commits appear as async slices.
+"""
+
+from __future__ import print_function
+
+import json, re, sys
+
+LINE_RE = re.compile(r'^ktrace (0x[0-9a-fA-F]+) (\d+) (\d+) (\d+) (0x[0-9a-fA-F]+) (0x[0-9a-fA-F]+)\s*$')
+
+CYCLES_PER_US = 10.0   # CLINT_MTIME runs at 10MHz in qemu
+
+# must match kernel/ktrace.h
+(KT_LOST, KT_SWITCHIN, KT_SWITCHOUT, KT_SLEEP, KT_WAKEUP, KT_DISKSUBMIT,
+ KT_DISKDONE, KT_COMMIT, KT_COMMITDONE, KT_PAGEFAULT) = range(10)
+
+# must match enum procstate in kernel/proc.h
+STATES = ['unused', 'used', 'sleeping', 'runnable', 'running', 'zombie']
+
+PID = 1       # the Chrome "process" that holds every track
+DISK_TID = 1000
+LOG_TID = 1001
+
+def parse(path):
+    with open(path, errors='replace') as f:
+        for line in f:
+            m = LINE_RE.match(line.strip())
+            if m:
+                yield (int(m.group(1), 16), int(m.group(2)), int(m.group(3)),
+                       int(m.group(4)), int(m.group(5), 16), int(m.group(6), 16))
+
+def convert(records):
+    records = sorted(records, key=lambda r: r[0])
+    if not records:
+        return []
+    t0 = records[0][0]
+    out = []
+    harts = set()
+    disk = {}
+
+    def ev(ph, name, t, tid, **kw):
+        e = {'ph': ph, 'name': name, 'ts': (t - t0) / CYCLES_PER_US,
+             'pid': PID, 'tid': tid}
+        e.update(kw)
+        out.append(e)
+
+    for t, hart, pid, typ, a0, a1 in records:
+        harts.add(hart)
+        if typ == KT_SWITCHIN:
+            ev('B', 'pid %d' % a0, t, hart)
+        elif typ == KT_SWITCHOUT:
+            state = STATES[a1] if a1 < len(STATES) else str(a1)
+            ev('E', 'pid %d' % a0, t, hart, args={'state': state})
+        elif typ == KT_SLEEP:
+            args = {'pid': pid, 'chan': hex(a0)}
+            if a1:
+                args['deadline'] = hex(a1)
+            ev('i', 'sleep', t, hart, s='t', args=args)
+        elif typ == KT_WAKEUP:
+            ev('i', 'wakeup pid %d' % a1, t, hart, s='t',
+               args={'by': pid, 'chan': hex(a0)})
+        elif typ == KT_DISKSUBMIT:
+            name = '%s %d' % ('write' if a1 else 'read', a0)
+            disk[a0] = name
+            ev('b', name, t, DISK_TID, cat='disk', id='blk%d' % a0,
+               args={'pid': pid})
+        elif typ == KT_DISKDONE:
+            ev('e', disk.pop(a0, 'block %d' % a0), t, DISK_TID, cat='disk',
+               id='blk%d' % a0)
+        elif typ == KT_COMMIT:
+            ev('b', 'commit', t, LOG_TID, cat='log', id='commit',
+               args={'blocks': a0, 'pid': pid})
+        elif typ == KT_COMMITDONE:
+            ev('e', 'commit', t, LOG_TID, cat='log', id='commit')
+        elif typ == KT_PAGEFAULT:
+            ev('i', 'page fault', t, hart, s='t',
+               args={'pid': pid, 'stval': hex(a0), 'scause': a1})
+        elif typ == KT_LOST:
+            ev('i', 'lost %d events' % a0, t, hart, s='g')
+
+    out.append({'ph': 'M', 'name': 'process_name', 'pid': PID,
+                'args': {'name': 'xv6'}})
+    for h in sorted(harts):
+        out.append({'ph': 'M', 'name': 'thread_name', 'pid': PID, 'tid': h,
+                    'args': {'name': 'hart %d' % h}})
+    return out
+
+def main():
+    if len(sys.argv) not in (2, 3):
+        print(__doc__.strip().splitlines()[2], file=sys.stderr)
+        return 1
+    events = convert(parse(sys.argv[1]))
+    if not events:
+        print('no ktrace records found in %s' % sys.argv[1], file=sys.stderr)
+        return 1
+    doc = {'traceEvents': events, 'displayTimeUnit': 'ns'}
+    if len(sys.argv) == 3:
+        with open(sys.argv[2], 'w') as f:
+            json.dump(doc, f)
+    else:
+        json.dump(doc, sys.stdout)
+        print()
+    return 0
+
+if __name__ == '__main__':
+    sys.exit(main())
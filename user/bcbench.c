@@ -0,0 +1,179 @@
+// bcbench: compare buffer cache replacement policies.
+//
+//   bcbench [maxbufs]
+//
+// Shrinks the block cache to maxbufs buffers, then, under each
+// policy in turn, alternates a metadata-heavy pass (look up and
+// read many small files) with a sequential read of a file larger
+// than the cache, and reports how often the metadata pass found
+// its blocks cached. A scan-resistant policy keeps them.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "kernel/fs.h"
+#include "kernel/sysctl.h"
+#include "user/user.h"
+
+#define NSMALL  48          // small files
+#define NBIG    200         // blocks in the big file
+#define ROUNDS  5
+#define STATSZ  (4*4096)
+
+char buf[BSIZE];
+char stats[STATSZ+1];
+char *policyname[] = { [BPOL_LRU] "lru", [BPOL_2Q] "2q" };
+
+void
+smallname(char *name, int i)
+{
+  strcpy(name, "bcb/f00");
+  name[5] = '0' + i / 10;
+  name[6] = '0' + i % 10;
+}
+
+void
+setup(void)
+{
+  char name[16];
+  int fd, i;
+
+  mkdir("bcb");
+  for(i = 0; i < NSMALL; i++){
+    smallname(name, i);
+    if((fd = open(name, O_CREATE|O_WRONLY)) < 0 || write(fd, buf, BSIZE) != BSIZE){
+      fprintf(2, "bcbench: cannot create %s\n", name);
+      exit(1);
+    }
+    close(fd);
+  }
+  if((fd = open("bcb/big", O_CREATE|O_WRONLY)) < 0){
+    fprintf(2, "bcbench: cannot create bcb/big\n");
+    exit(1);
+  }
+  for(i = 0; i < NBIG; i++){
+    if(write(fd, buf, BSIZE) != BSIZE){
+      fprintf(2, "bcbench: cannot write bcb/big\n");
+      exit(1);
+    }
+  }
+  close(fd);
+}
+
+void
+cleanup(void)
+{
+  char name[16];
+
+  for(int i = 0; i < NSMALL; i++){
+    smallname(name, i);
+    unlink(name);
+  }
+  unlink("bcb/big");
+  unlink("bcb");
+}
+
+void
+metadata(void)
+{
+  char name[16];
+  struct stat st;
+  int fd, i;
+
+  for(i = 0; i < NSMALL; i++){
+    smallname(name, i);
+    if(stat(name, &st) < 0 || (fd = open(name, O_RDONLY)) < 0){
+      fprintf(2, "bcbench: cannot open %s\n", name);
+      exit(1);
+    }
+    read(fd, buf, BSIZE);
+    close(fd);
+  }
+}
+
+void
+scan(void)
+{
+  int fd;
+
+  if((fd = open("bcb/big", O_RDONLY)) < 0){
+    fprintf(2, "bcbench: cannot open bcb/big\n");
+    exit(1);
+  }
+  while(read(fd, buf, BSIZE) > 0)
+    ;
+  close(fd);
+}
+
+// find policy p's "bcache policy NAME hits H misses M" line.
+void
+counters(int p, uint64 *hits, uint64 *misses)
+{
+  char want[32], *s, *nl;
+  int n;
+
+  strcpy(want, "bcache policy ");
+  strcpy(want + strlen(want), policyname[p]);
+  strcpy(want + strlen(want), " hits ");
+  n = statistics(stats, STATSZ);
+  stats[n] = 0;
+  *hits = *misses = 0;
+  for(s = stats; s && *s; s = nl){
+    if((nl = strchr(s, '\n')) != 0)
+      *nl++ = 0;
+    if(memcmp(s, want, strlen(want)) != 0)
+      continue;
+    s += strlen(want);
+    *hits = atou64(s);
+    while(*s >= '0' && *s <= '9')
+      s++;
+    *misses = atou64(s + strlen(" misses "));
+    return;
+  }
+}
+
+void
+run(int p)
+{
+  uint64 h0, m0, h1, m1, hits = 0, misses = 0;
+  int r, t0;
+
+  if(sysctl(CTL_BCACHEPOLICY, p) < 0){
+    fprintf(2, "bcbench: no policy %s\n", policyname[p]);
+    exit(1);
+  }
+  metadata();   // warm up
+  scan();
+  t0 = uptime();
+  for(r = 0; r < ROUNDS; r++){
+    counters(p, &h0, &m0);
+    metadata();
+    counters(p, &h1, &m1);
+    hits += h1 - h0;
+    misses += m1 - m0;
+    scan();
+  }
+  printf("%s: metadata hits %d misses %d (%d%% hit), %d ticks\n",
+         policyname[p], (int)hits, (int)misses,
+         (int)(hits * 100 / (hits + misses ? hits + misses : 1)),
+         uptime() - t0);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int max = 100, oldmax, oldpolicy;
+
+  if(argc > 1)
+    max = atoi(argv[1]);
+
+  setup();
+  oldpolicy = sysctl(CTL_BCACHEPOLICY, -1);
+  oldmax = sysctl(CTL_BCACHEMAX, max);
+  run(BPOL_LRU);
+  run(BPOL_2Q);
+  sysctl(CTL_BCACHEMAX, oldmax);
+  sysctl(CTL_BCACHEPOLICY, oldpolicy);
+  cleanup();
+  exit(0);
+}
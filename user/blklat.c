@@ -0,0 +1,114 @@
+// blklat: measure the latency of single-block disk reads, with
+// completions taken by interrupt and by polling.
+//
+//   blklat [rounds]
+//
+// Shrinks the block cache, then reads many one-block files over
+// and over, so that most reads miss the cache and wait for one
+// disk request, and reports the read() latency that sysstat()
+// saw under each setting of CTL_DISKPOLL.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "kernel/fs.h"
+#include "kernel/sysctl.h"
+#include "kernel/sysstat.h"
+#include "user/user.h"
+
+#define NFILE 64
+#define MAXSYS 64
+
+char buf[BSIZE];
+struct syscallstat st[MAXSYS];
+
+void
+filename(char *name, int i)
+{
+  strcpy(name, "blk/f00");
+  name[5] = '0' + i / 10;
+  name[6] = '0' + i % 10;
+}
+
+// read() statistics so far.
+struct syscallstat
+readstat(void)
+{
+  struct syscallstat r;
+  int i, n;
+
+  memset(&r, 0, sizeof(r));
+  n = sysstat(st, MAXSYS);
+  for(i = 0; i < n; i++)
+    if(strcmp(st[i].name, "read") == 0)
+      r = st[i];
+  return r;
+}
+
+void
+run(int poll, int rounds)
+{
+  struct syscallstat a, b;
+  char name[16];
+  int fd, i, r;
+
+  sysctl(CTL_DISKPOLL, poll);
+  a = readstat();
+  for(r = 0; r < rounds; r++){
+    for(i = 0; i < NFILE; i++){
+      filename(name, i);
+      if((fd = open(name, O_RDONLY)) < 0){
+        fprintf(2, "blklat: cannot open %s\n", name);
+        exit(1);
+      }
+      read(fd, buf, BSIZE);
+      close(fd);
+    }
+  }
+  b = readstat();
+
+  b.count -= a.count;
+  b.cycles -= a.cycles;
+  for(i = 0; i < NSYSHIST; i++)
+    b.hist[i] -= a.hist[i];
+  if(b.count == 0)
+    b.count = 1;
+  printf("%s: %d reads, avg %l us, p50 %l us, p99 %l us\n",
+         poll ? "poll" : "interrupt", (int)b.count,
+         b.cycles / b.count / TICKS_PER_US,
+         percentile(b.hist, NSYSHIST, 500), percentile(b.hist, NSYSHIST, 990));
+}
+
+int
+main(int argc, char *argv[])
+{
+  char name[16];
+  int fd, i, rounds = 10, oldmax, oldpoll;
+
+  if(argc > 1)
+    rounds = atoi(argv[1]);
+
+  mkdir("blk");
+  for(i = 0; i < NFILE; i++){
+    filename(name, i);
+    if((fd = open(name, O_CREATE|O_WRONLY)) < 0 || write(fd, buf, BSIZE) != BSIZE){
+      fprintf(2, "blklat: cannot create %s\n", name);
+      exit(1);
+    }
+    close(fd);
+  }
+
+  oldmax = sysctl(CTL_BCACHEMAX, 1);  // as small as it goes
+  oldpoll = sysctl(CTL_DISKPOLL, -1);
+  run(0, rounds);
+  run(1, rounds);
+  sysctl(CTL_DISKPOLL, oldpoll);
+  sysctl(CTL_BCACHEMAX, oldmax);
+
+  for(i = 0; i < NFILE; i++){
+    filename(name, i);
+    unlink(name);
+  }
+  unlink("blk");
+  exit(0);
+}
@@ -20,6 +20,7 @@ main(void)
     mknod("console", CONSOLE, 0);
     open("console", O_RDWR);
   }
+  mknod("statistics", STATS, 0);
   dup(0);  // stdout
   dup(0);  // stderr
 
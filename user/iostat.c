@@ -0,0 +1,107 @@
+// iostat: print the disk scheduler's counters.
+//
+//   iostat               totals since boot
+//   iostat command ...   only the requests made while command ran
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+#define BUFSZ (4*4096)
+#define NLATHIST 24
+
+char buf[BUFSZ+1];
+
+// the counters of the "disk" line, in order, then the
+// latency histogram of the "disklat" line.
+char *names[] = {
+  "requests", "blocks", "backmerge", "frontmerge", "late",
+  "queued", "maxqueued", "inflight", "maxinflight",
+  "polls", "pollhits", "pollavg",
+};
+
+// these are levels, not counts: report them as they are.
+char *levels[] = {
+  "queued", "maxqueued", "inflight", "maxinflight", "pollavg",
+};
+#define NELEM(x) (sizeof(x)/sizeof((x)[0]))
+#define NNAME NELEM(names)
+
+struct counters {
+  uint64 v[NNAME];
+  uint64 lat[NLATHIST];
+};
+
+// sum the counters of all disks.
+void
+snapshot(struct counters *c)
+{
+  char *p, *nl, *w;
+  int n, i;
+
+  memset(c, 0, sizeof(*c));
+  n = statistics(buf, BUFSZ);
+  buf[n] = 0;
+  for(p = buf; *p; p = nl){
+    if((nl = strchr(p, '\n')) == 0)
+      break;
+    *nl++ = 0;
+    w = word(&p);
+    if(strcmp(w, "disk") == 0){
+      word(&p);  // disk number
+      while(*(w = word(&p))){
+        for(i = 0; i < NNAME; i++)
+          if(strcmp(w, names[i]) == 0)
+            c->v[i] += atou64(word(&p));
+      }
+    } else if(strcmp(w, "disklat") == 0){
+      word(&p);
+      for(i = 0; i < NLATHIST; i++)
+        c->lat[i] += atou64(word(&p));
+    }
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct counters before, after;
+  int i, j, pid;
+
+  memset(&before, 0, sizeof(before));
+  if(argc > 1){
+    snapshot(&before);
+    pid = fork();
+    if(pid < 0){
+      fprintf(2, "iostat: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0){
+      exec(argv[1], argv+1);
+      fprintf(2, "iostat: exec %s failed\n", argv[1]);
+      exit(1);
+    }
+    wait(0);
+  }
+  snapshot(&after);
+
+  for(i = 0; i < NNAME; i++){
+    for(j = 0; j < NELEM(levels); j++)
+      if(strcmp(names[i], levels[j]) == 0)
+        break;
+    if(j == NELEM(levels))
+      after.v[i] -= before.v[i];
+  }
+  for(i = 0; i < NLATHIST; i++)
+    after.lat[i] -= before.lat[i];
+
+  for(i = 0; i < NNAME; i++)
+    printf("%s %l\n", names[i], after.v[i]);
+  if(after.v[0] > 0)
+    printf("blocks/request %l.%l\n", after.v[1] / after.v[0],
+           after.v[1] * 10 / after.v[0] % 10);
+  printf("latency(us) p50 %l p90 %l p99 %l\n",
+         percentile(after.lat, NLATHIST, 500), percentile(after.lat, NLATHIST, 900),
+         percentile(after.lat, NLATHIST, 990));
+  exit(0);
+}
@@ -0,0 +1,88 @@
+// ktrace: run a command with kernel event tracing on.
+//
+//   ktrace [-m mask] command [args...]
+//
+// mask selects event types (bit 1<<KT_*, default all), and
+// one line is printed per event:
+//   ktrace time hart pid type arg0 arg1
+// feed the console output to tracejson.py on the host.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/ktrace.h"
+#include "user/user.h"
+
+#define NREAD 32
+
+struct ktraceevent events[NREAD];
+
+// print the events recorded so far; return how many.
+int
+drain(void)
+{
+  int n, total = 0;
+
+  while((n = ktrace_read(events, NREAD)) > 0){
+    for(int i = 0; i < n; i++){
+      struct ktraceevent *e = &events[i];
+      printf("ktrace %p %d %d %d %p %p\n", e->time, e->hart, e->pid,
+             e->type, e->arg[0], e->arg[1]);
+    }
+    total += n;
+  }
+  return total;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int mask = (1 << NKTEVENT) - 1;
+  int pid, drainer, total;
+
+  if(argc > 2 && strcmp(argv[1], "-m") == 0){
+    mask = atoi(argv[2]);
+    argv += 2;
+    argc -= 2;
+  }
+  if(argc < 2){
+    fprintf(2, "usage: ktrace [-m mask] command [args...]\n");
+    exit(1);
+  }
+
+  if(ktrace(mask) < 0){
+    fprintf(2, "ktrace: ktrace failed\n");
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    fprintf(2, "ktrace: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    exec(argv[1], argv+1);
+    fprintf(2, "ktrace: exec %s failed\n", argv[1]);
+    exit(1);
+  }
+
+  // keep the per-hart rings from overflowing while the
+  // command runs. the console writes this causes are traced
+  // too, under the drainer's pid.
+  drainer = fork();
+  if(drainer == 0){
+    for(;;){
+      drain();
+      nanosleep(20*1000*1000);
+    }
+  }
+
+  while((total = wait(0)) != pid && total >= 0)
+    ;
+  ktrace(0);
+  if(drainer > 0){
+    kill(drainer);
+    wait(0);
+  }
+  total = drain();
+  printf("ktrace: done, %d events in last batch\n", total);
+  exit(0);
+}
@@ -0,0 +1,125 @@
+// lockstat: print lock contention, most contended first.
+//
+//   lockstat               totals since boot (or the last reset)
+//   lockstat command ...   reset, then report what command did
+//
+// Locks with the same name (e.g. the per-process "proc" locks)
+// are summed into one line; "n" is how many there are.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "user/user.h"
+
+#define BUFSZ (4*4096)
+#define MAXLOCK 128
+
+char buf[BUFSZ+1];
+
+struct lock {
+  char *name;
+  char *kind;
+  int n;
+  uint64 nacquire;
+  uint64 ncontend;
+  uint64 nspin;
+  uint64 maxhold;
+} locks[MAXLOCK];
+int nlock;
+
+// add one "name kind acquire contend spin maxhold" line.
+void
+add(char *line)
+{
+  char *name = word(&line);
+  char *kind = word(&line);
+  struct lock *l;
+  int i;
+  uint64 hold;
+
+  // the statistics device also reports other counters.
+  if(*name == 0 || (strcmp(kind, "spin") != 0 && strcmp(kind, "sleep") != 0 &&
+                    strcmp(kind, "rw") != 0))
+    return;
+  for(i = 0; i < nlock; i++)
+    if(strcmp(locks[i].name, name) == 0 && strcmp(locks[i].kind, kind) == 0)
+      break;
+  if(i == nlock){
+    if(nlock == MAXLOCK)
+      return;
+    nlock++;
+    locks[i].name = name;
+    locks[i].kind = kind;
+  }
+  l = &locks[i];
+  l->n++;
+  l->nacquire += atou64(word(&line));
+  l->ncontend += atou64(word(&line));
+  l->nspin += atou64(word(&line));
+  hold = atou64(word(&line));
+  if(hold > l->maxhold)
+    l->maxhold = hold;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int fd, n, i, j, pid;
+  char *p, *nl;
+  struct lock t;
+
+  if(argc > 1){
+    if((fd = open("statistics", O_WRONLY)) < 0 || write(fd, "0", 1) != 1){
+      fprintf(2, "lockstat: cannot reset statistics\n");
+      exit(1);
+    }
+    close(fd);
+    pid = fork();
+    if(pid < 0){
+      fprintf(2, "lockstat: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0){
+      exec(argv[1], argv+1);
+      fprintf(2, "lockstat: exec %s failed\n", argv[1]);
+      exit(1);
+    }
+    wait(0);
+  }
+
+  n = statistics(buf, BUFSZ);
+  buf[n] = 0;
+  for(p = buf; *p; p = nl){
+    if((nl = strchr(p, '\n')) == 0)
+      break;
+    *nl++ = 0;
+    add(p);
+  }
+
+  // sort by contended acquisitions, then by spins.
+  for(i = 1; i < nlock; i++){
+    for(j = i; j > 0; j--){
+      struct lock *a = &locks[j], *b = &locks[j-1];
+      if(a->ncontend < b->ncontend ||
+         (a->ncontend == b->ncontend && a->nspin <= b->nspin))
+        break;
+      t = *a;
+      *a = *b;
+      *b = t;
+    }
+  }
+
+  printpad("lock", 14);
+  printf("kind     n    acquire  contended      spins  maxhold(us)\n");
+  for(i = 0; i < nlock; i++){
+    printpad(locks[i].name, 14);
+    printpad(locks[i].kind, 5);
+    printnum(locks[i].n, 5);
+    printnum(locks[i].nacquire, 11);
+    printnum(locks[i].ncontend, 11);
+    printnum(locks[i].nspin, 11);
+    printnum(locks[i].maxhold / TICKS_PER_US, 13);
+    printf("\n");
+  }
+  exit(0);
+}
@@ -111,3 +111,31 @@ printf(const char *fmt, ...)
   va_start(ap, fmt);
   vprintf(1, fmt, ap);
 }
+
+// print s left-justified in a field of width w.
+void
+printpad(char *s, int w)
+{
+  int n = strlen(s);
+
+  printf("%s", s);
+  for(; n < w; n++)
+    printf(" ");
+}
+
+// print x right-justified in a field of width w.
+void
+printnum(uint64 x, int w)
+{
+  char buf[24];
+  int i = sizeof(buf) - 1;
+
+  buf[i] = 0;
+  do {
+    buf[--i] = '0' + x % 10;
+    x /= 10;
+  } while(x != 0 && i > 0);
+  while(sizeof(buf) - 1 - i < w)
+    buf[--i] = ' ';
+  printf("%s", buf + i);
+}
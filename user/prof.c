@@ -0,0 +1,89 @@
+// prof: run a command under the sampling profiler.
+//
+//   prof [-p period_us] command [args...]
+//
+// prints one line per sample:
+//   prof hart pid name k|u pc0 pc1 ...
+// feed the console output to profreport.py on the host.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/prof.h"
+#include "user/user.h"
+
+#define NREAD 32
+
+struct profsample samples[NREAD];
+
+// print the samples collected so far; return how many.
+int
+drain(void)
+{
+  int n, total = 0;
+
+  while((n = prof_read(samples, NREAD)) > 0){
+    for(int i = 0; i < n; i++){
+      struct profsample *s = &samples[i];
+      printf("prof %d %d %s %c", s->hart, s->pid,
+             s->name[0] ? s->name : "-", s->user ? 'u' : 'k');
+      for(int j = 0; j < s->depth; j++)
+        printf(" %p", s->pc[j]);
+      printf("\n");
+    }
+    total += n;
+  }
+  return total;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int period = 1000;
+  int pid, drainer, total;
+
+  if(argc > 2 && strcmp(argv[1], "-p") == 0){
+    period = atoi(argv[2]);
+    argv += 2;
+    argc -= 2;
+  }
+  if(argc < 2){
+    fprintf(2, "usage: prof [-p period_us] command [args...]\n");
+    exit(1);
+  }
+
+  if(prof_start(period) < 0){
+    fprintf(2, "prof: prof_start failed\n");
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    fprintf(2, "prof: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    exec(argv[1], argv+1);
+    fprintf(2, "prof: exec %s failed\n", argv[1]);
+    exit(1);
+  }
+
+  // keep the per-hart rings from overflowing while the
+  // command runs. the drainer's own samples are labelled "prof".
+  drainer = fork();
+  if(drainer == 0){
+    for(;;){
+      drain();
+      nanosleep(50*1000*1000);
+    }
+  }
+
+  while((total = wait(0)) != pid && total >= 0)
+    ;
+  prof_stop();
+  if(drainer > 0){
+    kill(drainer);
+    wait(0);
+  }
+  total = drain();
+  printf("prof: done, %d samples in last batch\n", total);
+  exit(0);
+}
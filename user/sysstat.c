@@ -0,0 +1,81 @@
+// sysstat: print per-system-call counts and latencies.
+//
+//   sysstat               totals since boot
+//   sysstat command ...   only the calls made while command ran
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/sysstat.h"
+#include "user/user.h"
+
+#define MAXSYS 64
+
+struct syscallstat before[MAXSYS], after[MAXSYS];
+
+int
+main(int argc, char *argv[])
+{
+  int n, i, j, pid;
+  int order[MAXSYS];
+
+  memset(before, 0, sizeof(before));
+  if(argc > 1){
+    if(sysstat(before, MAXSYS) < 0){
+      fprintf(2, "sysstat: sysstat failed\n");
+      exit(1);
+    }
+    pid = fork();
+    if(pid < 0){
+      fprintf(2, "sysstat: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0){
+      exec(argv[1], argv+1);
+      fprintf(2, "sysstat: exec %s failed\n", argv[1]);
+      exit(1);
+    }
+    wait(0);
+  }
+
+  if((n = sysstat(after, MAXSYS)) < 0){
+    fprintf(2, "sysstat: sysstat failed\n");
+    exit(1);
+  }
+
+  // subtract the baseline.
+  for(i = 0; i < n; i++){
+    after[i].count -= before[i].count;
+    after[i].errors -= before[i].errors;
+    after[i].cycles -= before[i].cycles;
+    for(j = 0; j < NSYSHIST; j++)
+      after[i].hist[j] -= before[i].hist[j];
+  }
+
+  // sort by total time, most expensive first.
+  for(i = 0; i < n; i++)
+    order[i] = i;
+  for(i = 1; i < n; i++){
+    for(j = i; j > 0 && after[order[j]].cycles > after[order[j-1]].cycles; j--){
+      int t = order[j];
+      order[j] = order[j-1];
+      order[j-1] = t;
+    }
+  }
+
+  printpad("syscall", 12);
+  printf("     calls    errors   total(us)  avg(us)  p50(us)  p99(us)\n");
+  for(i = 0; i < n; i++){
+    struct syscallstat *st = &after[order[i]];
+    if(st->name[0] == 0 || st->count == 0)
+      continue;
+    printpad(st->name, 12);
+    printnum(st->count, 10);
+    printnum(st->errors, 10);
+    printnum(st->cycles / TICKS_PER_US, 12);
+    printnum(st->cycles / st->count / TICKS_PER_US, 9);
+    printnum(percentile(st->hist, NSYSHIST, 500), 9);
+    printnum(percentile(st->hist, NSYSHIST, 990), 9);
+    printf("\n");
+  }
+  exit(0);
+}
@@ -134,3 +134,50 @@ memcpy(void *dst, const void *src, uint n)
 {
   return memmove(dst, src, n);
 }
+
+uint64
+atou64(const char *s)
+{
+  uint64 x = 0;
+
+  while(*s >= '0' && *s <= '9')
+    x = x*10 + *s++ - '0';
+  return x;
+}
+
+// split off the next space-separated word of *s.
+char*
+word(char **s)
+{
+  char *w;
+
+  while(**s == ' ')
+    (*s)++;
+  w = *s;
+  while(**s && **s != ' ')
+    (*s)++;
+  if(**s)
+    *(*s)++ = 0;
+  return w;
+}
+
+// upper bound, in microseconds, of the bucket of histogram
+// hist holding the given fraction (per mille) of its counts.
+// hist[b] counts times of [2^b, 2^(b+1)) CLINT_MTIME ticks.
+uint64
+percentile(uint64 *hist, int nbucket, int permille)
+{
+  uint64 seen = 0, total = 0;
+  int b;
+
+  for(b = 0; b < nbucket; b++)
+    total += hist[b];
+  if(total == 0)
+    return 0;
+  for(b = 0; b < nbucket; b++){
+    seen += hist[b];
+    if(seen >= (total * permille + 999) / 1000)
+      return ((2ULL << b) + TICKS_PER_US - 1) / TICKS_PER_US;
+  }
+  return 0;
+}
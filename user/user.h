@@ -1,5 +1,8 @@
 struct stat;
 struct rtcdate;
+struct syscallstat;
+struct profsample;
+struct ktraceevent;
 
 // system calls
 int fork(void);
@@ -23,6 +26,15 @@ int getpid(void);
 char* sbrk(int);
 int sleep(int);
 int uptime(void);
+int nanosleep(uint64);
+int sysstat(struct syscallstat*, int);
+int trace(int);
+int prof_start(int);
+int prof_stop(void);
+int prof_read(struct profsample*, int);
+int ktrace(int);
+int ktrace_read(struct ktraceevent*, int);
+int sysctl(int, int);
 
 // ulib.c
 int stat(const char*, struct stat*);
@@ -40,3 +52,15 @@ void free(void*);
 int atoi(const char*);
 int memcmp(const void *, const void *, uint);
 void *memcpy(void *, const void *, uint);
+uint64 atou64(const char*);
+char* word(char**);
+uint64 percentile(uint64*, int, int);
+
+// printf.c, for tables
+void printpad(char*, int);
+void printnum(uint64, int);
+
+#define TICKS_PER_US 10   // CLINT_MTIME runs at 10MHz in qemu
+
+// statistics.c
+int statistics(void*, int);
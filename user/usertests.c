@@ -809,6 +809,39 @@ killstatus(char *s)
   exit(0);
 }
 
+// nanosleep() should wake at its deadline: a short sleep
+// must not round up to a whole tick, and a long one must
+// not return early.
+void
+nanosleeptest(char *s)
+{
+  int t0, t1;
+
+  t0 = uptime();
+  for(int i = 0; i < 10; i++){
+    if(nanosleep(1000000) < 0){
+      printf("%s: nanosleep failed\n", s);
+      exit(1);
+    }
+  }
+  t1 = uptime();
+  if(t1 - t0 > 2){
+    printf("%s: 10 x nanosleep(1ms) took %d ticks\n", s, t1 - t0);
+    exit(1);
+  }
+
+  t0 = uptime();
+  if(nanosleep(300000000) < 0){
+    printf("%s: nanosleep failed\n", s);
+    exit(1);
+  }
+  t1 = uptime();
+  if(t1 - t0 < 2){
+    printf("%s: nanosleep(300ms) returned after %d ticks\n", s, t1 - t0);
+    exit(1);
+  }
+}
+
 // meant to be run w/ at most two CPUs
 void
 preempt(char *s)
@@ -2873,6 +2906,7 @@ main(int argc, char *argv[])
     {pipe1, "pipe1"},
     {killstatus, "killstatus"},
     {preempt, "preempt"},
+    {nanosleeptest, "nanosleep"},
     {exitwait, "exitwait"},
     {rmdot, "rmdot"},
     {fourteen, "fourteen"},
@@ -36,3 +36,12 @@ entry("getpid");
 entry("sbrk");
 entry("sleep");
 entry("uptime");
+entry("nanosleep");
+entry("sysstat");
+entry("trace");
+entry("prof_start");
+entry("prof_stop");
+entry("prof_read");
+entry("ktrace");
+entry("ktrace_read");
+entry("sysctl");